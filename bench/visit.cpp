@@ -0,0 +1,92 @@
+// Compares dispatching via visit with virtual calls and times the passes ported to visit.
+// Usage: dimpl-bench [num items]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dimpl/bind.h"
+#include "dimpl/parser.h"
+#include "dimpl/visit.h"
+
+using namespace dimpl;
+
+/// Best wall-clock time of @p f in milliseconds out of a few runs.
+template<class F> static double time(F&& f) {
+    double best = 1e300;
+    for (int run = 0; run != 7; ++run) {
+        auto begin = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+    return best;
+}
+
+/// Ten million Expr%s of different kinds in random order, so neither dispatch is predicted well.
+static void bench_dispatch() {
+    Comp comp;
+    auto id = comp.mk<Id>(Span(), comp.anonymous());
+    auto lit = comp.lit_expr(Tok(Span(), thorin::u64(1)));
+    std::vector<Ptr<Expr>> kinds = {
+        lit,
+        comp.mk<IdExpr>(std::move(id)),
+        comp.mk<ErrExpr>(Span()),
+        comp.mk<PrefixExpr>(Span(), Tok::Tag::O_not, lit),
+        comp.mk<InfixExpr>(Span(), lit, Tok::Tag::O_add, lit),
+        comp.mk<BlockExpr>(Span(), Ptrs<Stmt>(), lit),
+        comp.mk<IfExpr>(Span(), lit, lit, lit),
+        comp.mk<WhileExpr>(Span(), lit, nullptr),
+    };
+
+    std::mt19937 rng(42);
+    std::vector<Ptr<Expr>> exprs(10'000'000);
+    for (auto& expr : exprs) expr = kinds[rng() % kinds.size()];
+
+    size_t virt = 0, stat = 0;
+    auto t_virt = time([&] {
+        virt = 0;
+        for (auto expr : exprs) virt += expr->is_stmt_like();
+    });
+    auto t_stat = time([&] {
+        stat = 0;
+        for (auto expr : exprs) {
+            stat += visit<bool>(expr, [](auto expr) {
+                using T = std::remove_cvref_t<decltype(*expr)>;
+                return expr->T::is_stmt_like(); // qualified: no virtual call
+            });
+        }
+    });
+
+    if (virt != stat) std::abort();
+    std::printf("dispatch of %zu calls: virtual %.2f ms, visit %.2f ms\n", exprs.size(), t_virt, t_stat);
+}
+
+/// Binds a program of @p n items like <tt>fn f(a: Nat) → Nat { g(x + a * 2) }</tt>.
+static void bench_bind(size_t n) {
+    std::string text;
+    for (size_t i = 0; i != n; ++i) {
+        auto s = std::to_string(i), p = std::to_string(i == 0 ? 0 : i - 1);
+        text += "fn f" + s + "(a: Nat) → Nat { g" + s + "(x" + p + " + a * 2) }\n";
+        text += "fn g" + s + "(a: Nat) → Nat { f" + s + "(a) }\n";
+        text += "let x" + s + " = f" + s + "(" + s + ");\n";
+    }
+
+    Comp comp;
+    auto prg = parse(comp, text, "bench");
+    auto t = time([&] {
+        Scopes scopes(comp);
+        scopes.bind(prg);
+    });
+    std::printf("bind of %zu bytes: %.2f ms\n", text.size(), t);
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000;
+    bench_dispatch();
+    bench_bind(n);
+}
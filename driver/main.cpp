@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <fstream>
 #include <vector>
 #include <cctype>
@@ -7,10 +8,13 @@
 
 #include "dimpl/ast.h"
 #include "dimpl/bind.h"
+#include "dimpl/cache.h"
 #include "dimpl/comp.h"
 #include "dimpl/emit.h"
+#include "dimpl/flat.h"
 #include "dimpl/parser.h"
 #include "dimpl/print.h"
+#include "dimpl/streaming.h"
 
 #ifndef NDEBUG
 #define LOG_LEVELS "error|warn|info|verbose|debug"
@@ -25,11 +29,24 @@ static const auto usage =
 "\n"
 "Options:\n"
 "-h, --help                 produce this help message\n"
+"    --ast-cache <file>     load the AST from <file> if it has been written for\n"
+"                           the same source text; otherwise parse and write it\n"
 "    --emit-ast             emit AST of dimpl program\n"
 "    --emit-thorin          emit Thorin from dimpl program\n"
 "    --fancy                use fancy output: dimpl's AST dump uses only\n"
 "                           parentheses where necessary\n"
 "-o, --output               specifies the output module name\n"
+"    --max-errors <n>       stop lexing and parsing after <n> errors; 0 for no\n"
+"                           limit (default: 20)\n"
+"    --max-depth <n>        maximum nesting of expressions other than tuples and\n"
+"                           operators; 0 for no limit (default: 4096)\n"
+"    --lazy                 skip bodies of functions and nominals while parsing;\n"
+"                           parse them on first use\n"
+"    --pipeline             lex on a separate thread while parsing\n"
+"    --streaming            compile one top-level item at a time and release it\n"
+"                           afterwards; bounds memory by the largest item\n"
+"    --flat                 parse into the flat, index-based AST and bind and\n"
+"                           emit that\n"
 "\n"
 "Developer options:\n"
 "    --log <arg>            specifies log file; use '-' for stdout (default)\n"
@@ -67,7 +84,7 @@ int main(int argc, char** argv) {
         if (argc < 1) err("no input files");
 
         std::vector<std::string> infiles;
-        std::string log_name("-"), module_name;
+        std::string log_name("-"), module_name, cache_name;
 
         for (int i = 1; i != argc; ++i) {
             std::string cur_option;
@@ -88,12 +105,32 @@ int main(int argc, char** argv) {
             if (cmp("-h") || cmp("--help")) {
                 std::cout << usage;
                 return EXIT_SUCCESS;
+            } else if (cmp("--ast-cache")) {
+                cache_name = get_arg();
             } else if (cmp("--emit-ast")) {
                 comp.emit_ast = true;
             } else if (cmp("--emit-thorin")) {
                 comp.emit_ast = true;
             } else if (cmp("--fancy")) {
                 comp.fancy = true;
+            } else if (cmp("--max-errors")) {
+                auto n = get_arg();
+                if (n.empty() || !std::all_of(n.begin(), n.end(), [](char c) { return std::isdigit(c); }))
+                    err("invalid error limit '{}'", n);
+                comp.max_errors = std::stoi(n);
+            } else if (cmp("--max-depth")) {
+                auto n = get_arg();
+                if (n.empty() || !std::all_of(n.begin(), n.end(), [](char c) { return std::isdigit(c); }))
+                    err("invalid depth limit '{}'", n);
+                comp.max_depth = std::stoi(n);
+            } else if (cmp("--lazy")) {
+                comp.lazy = true;
+            } else if (cmp("--pipeline")) {
+                comp.pipeline = true;
+            } else if (cmp("--streaming")) {
+                comp.streaming = true;
+            } else if (cmp("--flat")) {
+                comp.flat = true;
             } else if (cmp("--log")) {
                 log_name = get_arg();
             } else if (cmp("--log-level")) {
@@ -160,10 +197,38 @@ int main(int argc, char** argv) {
         }
 
         auto filename = infiles.front().c_str();
-        std::ifstream file(filename, std::ios::binary);
-        auto prg = dimpl::parse(comp, file, filename);
+        if (comp.streaming) {
+            dimpl::Scopes scopes(comp);
+            Emitter emitter;
+            dimpl::for_each_item(comp, filename, scopes, [&](const Ptrs<Stmt>& item) {
+                if (comp.emit_ast) {
+                    for (auto stmt : item) stmt->dump();
+                }
+
+                if (comp.emit_thorin && comp.num_errors() == 0) emitter.emit_stmts(item);
+            });
+
+            return comp.num_errors() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (comp.flat) {
+            auto flat = dimpl::parse_flat_file(comp, filename);
+            auto decls = dimpl::bind(comp, flat);
+
+            if (comp.emit_ast) dimpl::unflatten(comp, flat)->dump();
+
+            if (comp.emit_thorin && comp.num_errors() == 0) {
+                Emitter emitter;
+                dimpl::emit(emitter, flat, decls);
+            }
+
+            return comp.num_errors() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        auto prg = cache_name.empty() ? dimpl::parse_file(comp, filename)
+                                      : dimpl::parse_file(comp, filename, cache_name.c_str());
         dimpl::Scopes scopes(comp);
-        prg->bind(scopes);
+        scopes.bind(prg);
 
         if (comp.emit_ast) {
             //Stream s;
@@ -173,7 +238,7 @@ int main(int argc, char** argv) {
 
         if (comp.emit_thorin && comp.num_errors() == 0) {
             Emitter emitter;
-            prg->emit(emitter);
+            emitter.emit(prg);
         }
 
         return EXIT_SUCCESS; // TODO deal with errors
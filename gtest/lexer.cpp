@@ -1,13 +1,130 @@
 #include "gtest/gtest.h"
 
+#include <cctype>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "dimpl/comp.h"
 #include "dimpl/lexer.h"
 
 using namespace dimpl;
 
+namespace {
+
+/// The accept-chain Lexer::lex used before fixed tokens were recognized by a DFA; only used as a reference.
+/// Identifiers and keywords yield Tok::Tag::M_id, decimal literals Tok::Tag::L_u.
+std::vector<Tok::Tag> chain_lex(std::string_view s) {
+    using Tag = Tok::Tag;
+    std::vector<Tag> res;
+    size_t i = 0;
+    auto accept = [&](std::string_view x) {
+        if (!s.substr(i).starts_with(x)) return false;
+        i += x.size();
+        return true;
+    };
+    auto is = [&](auto pred) { return i != s.size() && pred((unsigned char) s[i]); };
+
+    while (true) {
+        auto push = [&](Tag tag) { res.emplace_back(tag); };
+        if (i == s.size()) {
+            push(Tag::M_eof);
+            return res;
+        }
+
+        if (is(isspace)) { ++i; continue; }
+
+        // delimiters
+        if (accept("(")) { push(Tag::D_paren_l);   continue; }
+        if (accept(")")) { push(Tag::D_paren_r);   continue; }
+        if (accept("[")) { push(Tag::D_bracket_l); continue; }
+        if (accept("]")) { push(Tag::D_bracket_r); continue; }
+        if (accept("{")) { push(Tag::D_brace_l);   continue; }
+        if (accept("}")) { push(Tag::D_brace_r);   continue; }
+        if (accept("«")) { push(Tag::D_quote_l);   continue; }
+        if (accept("»")) { push(Tag::D_quote_r);   continue; }
+        if (accept("‹")) { push(Tag::D_angle_l);   continue; }
+        if (accept("›")) { push(Tag::D_angle_r);   continue; }
+
+        // punctation
+        if (accept("→")) { push(Tag::P_arrow);     continue; }
+        if (accept(".")) { push(Tag::P_dot);       continue; }
+        if (accept(",")) { push(Tag::P_comma);     continue; }
+        if (accept(";")) { push(Tag::P_semicolon); continue; }
+        if (accept(":")) { push(accept(":") ? Tag::P_colon_colon : Tag::P_colon); continue; }
+
+        // binder
+        if (accept("λ"))  { push(Tag::B_lam);    continue; }
+        if (accept("∀"))  { push(Tag::B_forall); continue; }
+        if (accept("\\")) { push(accept("/") ? Tag::B_forall : Tag::B_lam); continue; }
+
+        // operators/assignments
+        if (accept("=")) {
+            push(accept("=") ? Tag::O_eq : Tag::A_assign);
+        } else if (accept("<")) {
+            if (accept("<"))
+                push(accept("=") ? Tag::A_shl_assign : Tag::O_shl);
+            else
+                push(accept("=") ? Tag::O_le : Tag::O_lt);
+        } else if (accept(">")) {
+            if (accept(">"))
+                push(accept("=") ? Tag::A_shr_assign : Tag::O_shr);
+            else
+                push(accept("=") ? Tag::O_ge : Tag::O_gt);
+        } else if (accept("+")) {
+            push(accept("+") ? Tag::O_inc : accept("=") ? Tag::A_add_assign : Tag::O_add);
+        } else if (accept("-")) {
+            push(accept(">") ? Tag::P_arrow : accept("-") ? Tag::O_dec : accept("=") ? Tag::A_sub_assign : Tag::O_sub);
+        } else if (accept("*")) {
+            push(accept("=") ? Tag::A_mul_assign : Tag::O_mul);
+        } else if (accept("/")) {
+            if (accept("*")) {
+                auto end = s.find("*/", i);
+                i = end == std::string_view::npos ? s.size() : end + 2;
+            } else if (accept("/")) {
+                auto end = s.find('\n', i);
+                i = end == std::string_view::npos ? s.size() : end;
+            } else {
+                push(accept("=") ? Tag::A_div_assign : Tag::O_div);
+            }
+        } else if (accept("%")) {
+            push(accept("=") ? Tag::A_rem_assign : Tag::O_rem);
+        } else if (accept("&")) {
+            push(accept("&") ? Tag::O_and_and : accept("=") ? Tag::A_and_assign : Tag::O_and);
+        } else if (accept("|")) {
+            push(accept("|") ? Tag::O_or_or : accept("=") ? Tag::A_or_assign : Tag::O_or);
+        } else if (accept("^")) {
+            push(accept("=") ? Tag::A_xor_assign : Tag::O_xor);
+        } else if (accept("!")) {
+            push(accept("=") ? Tag::O_ne : accept("[") ? Tag::D_not_bracket_l : Tag::O_not);
+        } else if (accept("~")) { // missing in the original chain although O_tilde is in DIMPL_OP
+            push(Tag::O_tilde);
+        } else if (is(isdigit)) {
+            while (is(isdigit)) ++i;
+            push(Tag::L_u);
+        } else if (is(isalpha) || is([](int c) { return c == '_'; })) {
+            while (is(isalnum) || is([](int c) { return c == '_'; })) ++i;
+            push(Tag::M_id);
+        } else {
+            ++i; // invalid character
+            while (is([](int c) { return (c & 0b11000000) == 0b10000000; })) ++i;
+        }
+    }
+}
+
+std::vector<Tok::Tag> dfa_lex(std::string_view s) {
+    Comp comp;
+    Lexer lexer(comp, s, "stdin");
+    std::vector<Tok::Tag> res;
+    while (true) {
+        auto tok = lexer.lex();
+        res.emplace_back(tok.is_key() ? Tok::Tag::M_id : tok.tag());
+        if (tok.isa(Tok::Tag::M_eof)) return res;
+    }
+}
+
+}
+
 TEST(Lexer, Toks) {
     Comp comp;
     std::istringstream is("{ } ( ) [ ] ‹ › « » : , . \\ \\/ λ ∀");
@@ -33,6 +150,28 @@ TEST(Lexer, Toks) {
     EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
 }
 
+TEST(Lexer, Keys) {
+    Comp comp;
+    std::string text;
+#define CODE(t, str) text += str " ";
+    DIMPL_KEY(CODE)
+#undef CODE
+    text += "Cnx tru trues If nomm _ while_ else0";
+    Lexer lexer(comp, text, "stdin");
+
+#define CODE(t, str)                                \
+    {                                               \
+        auto tok = lexer.lex();                     \
+        EXPECT_TRUE(tok.isa(Tok::Tag::t));          \
+        EXPECT_EQ(tok.sym(), comp.sym(str));        \
+    }
+    DIMPL_KEY(CODE)
+#undef CODE
+    for (int i = 0; i != 8; ++i)
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_id));
+    EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
+}
+
 TEST(Lexer, Loc) {
     Comp comp;
     std::istringstream is(" test  abc    def if  \nwhile λ foo   ");
@@ -48,20 +187,201 @@ TEST(Lexer, Loc) {
     StringStream s;
     s.fmt("{} {} {} {} {} {} {} {}", t1, t2, t3, t4, t5, t6, t7, t8);
     EXPECT_EQ(s.str(), "test abc def if while λ foo <eof>");
-    EXPECT_EQ(t1.loc(), Loc("stdin", {1,  2}, {1,  5}));
-    EXPECT_EQ(t2.loc(), Loc("stdin", {1,  8}, {1, 10}));
-    EXPECT_EQ(t3.loc(), Loc("stdin", {1, 15}, {1, 17}));
-    EXPECT_EQ(t4.loc(), Loc("stdin", {1, 19}, {1, 20}));
-    EXPECT_EQ(t5.loc(), Loc("stdin", {2,  1}, {2,  5}));
-    EXPECT_EQ(t6.loc(), Loc("stdin", {2,  7}, {2,  7}));
-    EXPECT_EQ(t7.loc(), Loc("stdin", {2,  9}, {2, 11}));
-    EXPECT_EQ(t8.loc(), Loc("stdin", {2, 14}, {2, 14}));
+    EXPECT_EQ(comp.loc(t1.loc()), Loc("stdin", {1,  2}, {1,  5}));
+    EXPECT_EQ(comp.loc(t2.loc()), Loc("stdin", {1,  8}, {1, 10}));
+    EXPECT_EQ(comp.loc(t3.loc()), Loc("stdin", {1, 15}, {1, 17}));
+    EXPECT_EQ(comp.loc(t4.loc()), Loc("stdin", {1, 19}, {1, 20}));
+    EXPECT_EQ(comp.loc(t5.loc()), Loc("stdin", {2,  1}, {2,  5}));
+    EXPECT_EQ(comp.loc(t6.loc()), Loc("stdin", {2,  7}, {2,  7}));
+    EXPECT_EQ(comp.loc(t7.loc()), Loc("stdin", {2,  9}, {2, 11}));
+    EXPECT_EQ(comp.loc(t8.loc()), Loc("stdin", {2, 15}, {2, 15})); // <eof> is one past the last character
+}
+
+TEST(Lexer, Buffer) {
+    Comp comp;
+    std::string_view text("if x0 foo", 5); // not null-terminated
+    Lexer lexer(comp, text, "buffer");
+
+    auto t1 = lexer.lex();
+    auto t2 = lexer.lex();
+    EXPECT_TRUE(t1.isa(Tok::Tag::K_if));
+    EXPECT_TRUE(t2.isa(Tok::Tag::M_id));
+    EXPECT_EQ(t2.sym(), comp.sym("x0"));
+    EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
+
+    // the Comp keeps its own copy: Span%s still decode once the caller's text is gone
+    std::string temp = "x\ny";
+    Lexer copy(comp, temp, "temp");
+    copy.lex();
+    auto y = copy.lex();
+    temp.assign(temp.size(), ' ');
+    EXPECT_EQ(comp.loc(y.loc()), Loc("temp", {2, 1}, {2, 1}));
+}
+
+TEST(Lexer, Syms) {
+    Comp comp;
+    auto foo = comp.sym("foo");
+    EXPECT_EQ(foo, comp.sym(std::string("foo")));
+    EXPECT_EQ(foo.str(), "foo");
+    EXPECT_EQ(comp.syms().sym(foo.id()), foo);
+    EXPECT_FALSE(foo == comp.sym("fo"));
+
+    std::vector<Sym> syms;
+    for (int i = 0; i < 5000; ++i) syms.emplace_back(comp.sym("x" + std::to_string(i)));
+    for (int i = 0; i < 5000; ++i) EXPECT_EQ(syms[i], comp.sym("x" + std::to_string(i)));
+    EXPECT_EQ(comp.sym2def(foo), comp.sym2def(comp.sym("foo")));
+}
+
+TEST(Lexer, Comments) {
+    Comp comp;
+    std::string text = "/* a λ\n ** b */ x // ∀ c\n" + std::string(40, ' ') + "y /* " + std::string(50, 'w') + " */ z";
+    Lexer lexer(comp, text, "stdin");
+
+    EXPECT_EQ(comp.loc(lexer.lex().loc()), Loc("stdin", {2, 10}, {2, 10}));
+    EXPECT_EQ(comp.loc(lexer.lex().loc()), Loc("stdin", {3, 41}, {3, 41}));
+    EXPECT_EQ(comp.loc(lexer.lex().loc()), Loc("stdin", {3, 100}, {3, 100}));
+    EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
+    EXPECT_EQ(comp.num_errors(), 0);
+}
+
+TEST(Lexer, LexAll) {
+    Comp comp;
+    Lexer lexer(comp, " foo 42 if\n+= 1.5", "stdin");
+    auto toks = lexer.lex_all();
+    ASSERT_EQ(toks.size(), 6);
+    EXPECT_EQ(toks.tag(0), Tok::Tag::M_id);
+    EXPECT_EQ(toks.tag(1), Tok::Tag::L_u);
+    EXPECT_EQ(toks.tag(2), Tok::Tag::K_if);
+    EXPECT_EQ(toks.tag(3), Tok::Tag::A_add_assign);
+    EXPECT_EQ(toks.tag(4), Tok::Tag::L_f);
+    EXPECT_EQ(toks.tag(5), Tok::Tag::M_eof);
+    EXPECT_EQ(toks.offset(0), 1);
+    EXPECT_EQ(toks.offset(3), 11);
+    EXPECT_EQ(toks.offset(5), 17);
+    EXPECT_EQ(toks[0].sym(), comp.sym("foo"));
+    EXPECT_EQ(toks[1].u(), 42_u64);
+    EXPECT_EQ(toks[2].sym(), comp.key(Tok::Tag::K_if));
+    EXPECT_EQ(toks[4].f(), 1.5);
+    EXPECT_EQ(comp.loc(toks[3].loc()), Loc("stdin", {2, 1}, {2, 2}));
+}
+
+TEST(Lexer, Parallel) {
+    // too many errors spread over several chunks
+    std::string errors;
+    for (int i = 0; i != 15; ++i) errors += "a $ b\n";
+    errors += std::string(199, ' ') + "\n";
+    for (int i = 0; i != 15; ++i) errors += "c $ d\n";
+
+    std::string texts[] = {
+        "a b c\nd 1 2.5\ne /* x\ny\nz */ f\ng // h\ni 0x10 j\n",
+        "a /* b\n/* c\nd */ e\nf /* g\nh\n",        // comment re-opened in a chunk that starts in a comment; never closed
+        "a\nb\n/*\n*/\n/*\n*/ c\nd /*\ne",
+        "a b\nc \xff d\ne f\n",                    // stops at invalid utf-8
+        "a /*\nb\n\xe2\x86 c\nd */",
+        "a 18446744073709551616\nb ä\nc\n",         // errors in several chunks
+        "\ufeffa\nb",
+        "",
+        errors,
+    };
+
+    for (const auto& text : texts) {
+        for (size_t chunk_size : {1, 2, 5, 64, 1 << 20}) {
+            for (int max_errors : {20, 1, 0}) {
+                std::string expected, actual;
+                Comp comp1, comp2;
+                comp1.max_errors = comp2.max_errors = max_errors;
+                testing::internal::CaptureStderr();
+                auto toks1 = Lexer(comp1, text, "stdin").lex_all();
+                expected = testing::internal::GetCapturedStderr();
+                testing::internal::CaptureStderr();
+                auto toks2 = lex_parallel(comp2, Source::borrow(text, "stdin"), chunk_size);
+                actual = testing::internal::GetCapturedStderr();
+
+                EXPECT_EQ(expected, actual) << text;
+                EXPECT_EQ(comp1.num_errors(), comp2.num_errors()) << text;
+                if (text == errors) { EXPECT_EQ(comp2.num_errors(), max_errors == 0 ? 30 : max_errors); }
+                ASSERT_EQ(toks1.size(), toks2.size()) << text;
+                for (size_t i = 0, e = toks1.size(); i != e; ++i) {
+                    Tok tok1 = toks1[i], tok2 = toks2[i];
+                    EXPECT_EQ(tok1.tag(), tok2.tag());
+                    EXPECT_EQ(tok1.loc().begin, tok2.loc().begin);
+                    EXPECT_EQ(tok1.loc().finis, tok2.loc().finis);
+                    if (tok1.isa(Tok::Tag::M_id)) { EXPECT_EQ(tok1.sym().str(), tok2.sym().str()); }
+                    if (tok1.isa(Tok::Tag::L_u)) { EXPECT_EQ(tok1.u(), tok2.u()); }
+                    if (tok1.isa(Tok::Tag::L_f)) { EXPECT_EQ(tok1.f(), tok2.f()); }
+                }
+            }
+        }
+    }
 }
 
 TEST(Lexer, Literals) {
+    {
+        Comp comp;
+        Lexer lexer(comp, "0 42 0x1F 0b101 0o17 1.5 2e3 1.e+2 18446744073709551615 1e-400 0.5e-323", "stdin");
+        EXPECT_EQ(lexer.lex().u(), 0_u64);
+        EXPECT_EQ(lexer.lex().u(), 42_u64);
+        EXPECT_EQ(lexer.lex().u(), 0x1F_u64);
+        EXPECT_EQ(lexer.lex().u(), 5_u64);
+        EXPECT_EQ(lexer.lex().u(), 15_u64);
+        EXPECT_EQ(lexer.lex().f(), 1.5);
+        EXPECT_EQ(lexer.lex().f(), 2e3);
+        EXPECT_EQ(lexer.lex().f(), 1e2);
+        EXPECT_EQ(lexer.lex().u(), 18446744073709551615_u64);
+        EXPECT_EQ(lexer.lex().f(), 0.0); // underflow
+        EXPECT_EQ(lexer.lex().f(), 5e-324);
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
+        EXPECT_EQ(comp.num_errors(), 0);
+    }
+
+    for (auto text : {"18446744073709551616", "0x1ffffffffffffffff", "1e999", "0.01e311", "0x"}) {
+        Comp comp;
+        Lexer lexer(comp, text, "stdin");
+        EXPECT_TRUE(lexer.lex().is_lit());
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
+        EXPECT_EQ(comp.num_errors(), 1) << text;
+    }
 }
 
 TEST(Lexer, Utf8) {
+    {
+        Comp comp;
+        Lexer lexer(comp, "\ufeffλ x → ä", "stdin"); // BOM, then ä is an invalid character but valid utf-8
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::B_lam));
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_id));
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::P_arrow));
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
+        EXPECT_EQ(comp.num_errors(), 1);
+    }
+
+    for (auto text : {"a \xff b", "a \xc0\xaf b", "a \xed\xa0\x80 b", "a \xf4\x90\x80\x80 b", "a \xe2\x86"}) {
+        Comp comp;
+        Lexer lexer(comp, text, "stdin");
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_id));
+        EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
+        EXPECT_EQ(comp.num_errors(), 1);
+    }
+}
+
+TEST(Lexer, ErrorLimit) {
+    std::string text;
+    for (int i = 0; i != 1000; ++i) text += "a ä ";
+
+    Comp comp;
+    testing::internal::CaptureStderr();
+    Lexer lexer(comp, text, "stdin");
+    size_t num = lexer.lex_all().size();
+    auto errs = testing::internal::GetCapturedStderr();
+    EXPECT_EQ(comp.num_errors(), comp.max_errors);
+    EXPECT_NE(errs.find("too many errors; giving up"), std::string::npos);
+    EXPECT_EQ(num, size_t(comp.max_errors) + 1);
+    EXPECT_FALSE(lexer.valid());
+
+    comp.max_errors = 0;
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(Lexer(comp, text, "stdin").lex_all().size(), 1001u);
+    testing::internal::GetCapturedStderr();
+    EXPECT_EQ(comp.num_errors(), 20 + 1000);
 }
 
 TEST(Lexer, Eof) {
@@ -72,3 +392,31 @@ TEST(Lexer, Eof) {
     for (int i = 0; i < 100; i++)
         EXPECT_TRUE(lexer.lex().isa(Tok::Tag::M_eof));
 }
+
+TEST(Lexer, Dfa) {
+    for (auto text : {"{ } ( ) [ ] ‹ › « » : , . \\ \\/ λ ∀",
+                      " test  abc    def if  \nwhile λ foo   ",
+                      "/* a λ\n ** b */ x // ∀ c\n y /* w */ z",
+                      "λ x → ä",
+                      "a<<=b>>=c->d!=e![f::g:h\\/i\\j/=k//l\nm/*n*/o~p++q--r&&s||t%=u"}) {
+        EXPECT_EQ(dfa_lex(text), chain_lex(text)) << text;
+    }
+
+    // all pairs of fixed tokens - with and without a space in between
+    std::vector<std::string> fixes = {"\\", "\\/", "->"};
+#define CODE(t, str) if (Tok::Tag::t != Tok::Tag::M_eof && Tok::Tag::t != Tok::Tag::M_id) fixes.emplace_back(str);
+    DIMPL_TOK(CODE)
+#undef CODE
+#define CODE(t, str, name) fixes.emplace_back(str);
+    DIMPL_ASSIGN(CODE)
+#undef CODE
+#define CODE(t, str, prec, name) fixes.emplace_back(str);
+    DIMPL_OP(CODE)
+#undef CODE
+    for (auto&& a : fixes) {
+        for (auto&& b : fixes) {
+            for (auto text : {a + b, a + " " + b})
+                EXPECT_EQ(dfa_lex(text), chain_lex(text)) << text;
+        }
+    }
+}
@@ -1,10 +1,18 @@
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <fstream>
 #include <sstream>
 #include <string>
 
 #include "thorin/util/stream.h"
+#include "dimpl/bind.h"
+#include "dimpl/cache.h"
+#include "dimpl/document.h"
+#include "dimpl/emit.h"
+#include "dimpl/flat.h"
 #include "dimpl/parser.h"
+#include "dimpl/streaming.h"
 
 using namespace dimpl;
 
@@ -114,6 +122,14 @@ TEST(Parser, Tuple) {
     parse_expr(comp, "(x,   y=b,): T");
 
     EXPECT_EQ(comp.num_errors(), 0);
+
+    // more elements than a PtrsBuilder keeps on the stack
+    auto tup = as<TupExpr>(parse_expr(comp, "(a, b, c, d, e, f, g, h, i, j, (k, l, m, n, o, p, q, r, s, t), u)"));
+    ASSERT_EQ(tup->elems.size(), 12);
+    EXPECT_EQ(as<IdExpr>(tup->elems[9]->expr)->sym().str(), "j");
+    EXPECT_EQ(as<IdExpr>(tup->elems.back()->expr)->sym().str(), "u");
+    EXPECT_EQ(as<TupExpr>(tup->elems[10]->expr)->elems.size(), 10);
+    EXPECT_EQ(comp.num_errors(), 0);
 }
 
 TEST(Parser, Variadic) {
@@ -122,3 +138,675 @@ TEST(Parser, Variadic) {
     parse_expr(comp, "ar[int; y]");
     EXPECT_EQ(comp.num_errors(), 0);
 }
+
+TEST(Parser, Toks) {
+    for (auto text : {"{ let x: int = 23; if x < 0x2a { f(x, y.z) } else { ar[int; 3] } }",
+                      "λ(a: T, b: U) { a + b * -c }",
+                      "{ if cond { x } else if cond { y } else { z }; foo }"}) {
+        Comp comp;
+        StringStream s1, s2;
+        Parser(comp, text, "stdin").parse_expr("global expression")->stream(s1);
+        Parser(comp, Lexer(comp, text, "stdin").lex_all()).parse_expr("global expression")->stream(s2);
+        EXPECT_EQ(s1.str(), s2.str());
+        EXPECT_EQ(comp.num_errors(), 0) << text;
+    }
+}
+
+TEST(Parser, Pipeline) {
+    std::string text;
+    for (int i = 0; i != 2000; ++i) text += "let x" + std::to_string(i) + " = f(a, b.c) + " + std::to_string(i) + ";\n";
+    text += "let y = $ (;\n"; // lexer error followed by parser errors
+
+    std::string expected, actual;
+    StringStream s1, s2;
+    int errors1, errors2;
+    {
+        Comp comp;
+        testing::internal::CaptureStderr();
+        Parser(comp, text, "stdin").parse_prg()->stream(s1);
+        expected = testing::internal::GetCapturedStderr();
+        errors1 = comp.num_errors();
+    }
+    {
+        Comp comp;
+        testing::internal::CaptureStderr();
+        Parser(comp, std::make_unique<LexerThread>(comp, Source::borrow(text, "stdin"))).parse_prg()->stream(s2);
+        actual = testing::internal::GetCapturedStderr();
+        errors2 = comp.num_errors();
+    }
+
+    EXPECT_EQ(s1.str(), s2.str());
+    EXPECT_EQ(expected, actual);
+    EXPECT_NE(errors1, 0);
+    EXPECT_EQ(errors1, errors2);
+}
+
+TEST(Parser, Flat) {
+    static const auto text =
+        "fn f(a: int, b: int) → int {\n"
+        "    let x = a + b * -1.5;\n"
+        "    let (y, mut z) = (x, ar[int; 3], pk(i: int; i));\n"
+        "    z += if x < 0x2a { g(y)(z) } else { u };\n"
+        "    while z { z = z.w; }\n"
+        "    f(a, b, _)\n"
+        "}\n"
+        "fn g(a: int) → [T: Type, T] = λ(a: T) { a }\n"
+        "fn g(b: int) = Fn [c: int] → c\n";
+
+    Comp comp;
+    testing::internal::CaptureStderr();
+    auto prg = parse(comp, text, "stdin");
+    auto errs = testing::internal::GetCapturedStderr();
+    EXPECT_EQ(errs, "");
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    auto flat = flatten(prg);
+    StringStream s1, s2;
+    prg->stream(s1);
+    unflatten(comp, flat)->stream(s2);
+    EXPECT_EQ(s1.str(), s2.str());
+
+    std::string expected, actual;
+    testing::internal::CaptureStderr();
+    Scopes scopes(comp);
+    scopes.bind(prg);
+    expected = testing::internal::GetCapturedStderr();
+    auto num_errors = comp.num_errors();
+
+    testing::internal::CaptureStderr();
+    auto decls = bind(comp, flat);
+    actual = testing::internal::GetCapturedStderr();
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(comp.num_errors(), 2 * num_errors);
+    EXPECT_NE(num_errors, 0);
+
+    // every resolved use refers to a declaration of the same name
+    size_t num_uses = 0;
+    for (FlatAST::Ref ref = 0, e = flat.size(); ref != e; ++ref) {
+        if (flat.node(ref) != Node::IdExpr || decls[ref] == FlatAST::None) continue;
+        EXPECT_EQ(flat.lhs(flat.lhs(ref)), flat.lhs(flat.decl_id(decls[ref])));
+        ++num_uses;
+    }
+    EXPECT_GT(num_uses, 10);
+
+    // parsing straight into the flat form yields the same FlatAST
+    Comp fresh;
+    auto direct = Parser(fresh, text, "stdin").parse_flat_prg();
+    ASSERT_EQ(direct.size(), flat.size());
+    for (FlatAST::Ref ref = 0, e = flat.size(); ref != e; ++ref) {
+        EXPECT_EQ(direct.node(ref), flat.node(ref));
+        EXPECT_EQ(direct.aux(ref), flat.aux(ref));
+        EXPECT_EQ(direct.loc(ref), flat.loc(ref));
+    }
+    StringStream s3;
+    unflatten(fresh, direct)->stream(s3);
+    EXPECT_EQ(s1.str(), s3.str());
+}
+
+TEST(Parser, FlatParse) {
+    std::string text;
+    for (int i = 0; i != 2000; ++i) {
+        auto n = std::to_string(i);
+        text += "fn f" + n + "(a: int) → int { let b = (a, pk(c: int; c)); if a < " + n + " { b.x } else { f(a - 1) } }\n";
+    }
+
+    // each top-level Stmt is released once flattened
+    Comp tree, flat;
+    parse(tree, Source::borrow(text, "stdin"));
+    auto prg = Parser(flat, Source::borrow(text, "stdin")).parse_flat_prg();
+    EXPECT_EQ(tree.num_errors(), 0);
+    EXPECT_EQ(flat.num_errors(), 0);
+    EXPECT_LT(4 * flat.mark().arena.num_blocks, tree.mark().arena.num_blocks);
+    EXPECT_EQ(prg.list(prg.lhs(prg.root())).size(), 2000u);
+}
+
+namespace {
+
+/// Collects the Def of each IdPtrn in walk order.
+class PtrnDefs : public Walker<PtrnDefs> {
+public:
+    using Walker::enter;
+    bool enter(const IdPtrn* ptrn) { return defs.emplace_back(ptrn->def), true; }
+
+    std::vector<const thorin::Def*> defs;
+};
+
+}
+
+TEST(Parser, FlatEmit) {
+    static const auto text =
+        "fn g(a: Nat) = a;\n"
+        "let (x: Nat, (y: Nat, w: Nat)) = (g(1), (Nat, Type));\n"
+        "let z: Nat;\n"
+        "let u = { let q = Kind; fn h(q: Nat) = q; let (m: Nat, n: Nat) = (h(1), q); m };\n"
+        "let p = if x { y } else { z };\n";
+
+    PtrnDefs expected;
+    Emitter tree;
+    testing::internal::CaptureStdout();
+    auto prg = parse(tree.comp, text, "stdin");
+    Scopes(tree.comp).bind(prg);
+    tree.emit(prg);
+    expected.walk(prg);
+    auto out1 = testing::internal::GetCapturedStdout();
+
+    Emitter flat;
+    testing::internal::CaptureStdout();
+    auto fprg = Parser(flat.comp, text, "stdin").parse_flat_prg();
+    auto defs = emit(flat, fprg, bind(flat.comp, fprg));
+    auto out2 = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(tree.comp.num_errors(), 0);
+    EXPECT_EQ(flat.comp.num_errors(), 0);
+
+    // the same Defs are built in the same order
+    std::vector<const thorin::Def*> actual;
+    for (FlatAST::Ref ref = 0, e = fprg.size(); ref != e; ++ref)
+        if (fprg.node(ref) == Node::IdPtrn) actual.emplace_back(defs[ref]);
+    ASSERT_EQ(actual.size(), expected.defs.size());
+    for (size_t i = 0, e = actual.size(); i != e; ++i) {
+        ASSERT_EQ(actual[i] == nullptr, expected.defs[i] == nullptr) << i;
+        if (actual[i]) { EXPECT_EQ(actual[i]->gid(), expected.defs[i]->gid()) << i; }
+    }
+    EXPECT_GE(std::ranges::count_if(actual, [](auto def) { return def != nullptr; }), 5);
+    EXPECT_EQ(flat.world().type()->gid(), tree.world().type()->gid());
+    EXPECT_EQ(out1, out2);
+}
+
+TEST(Parser, Leaves) {
+    Comp comp;
+    auto prg = parse(comp, "fn f(a, b) = { let x = 1 + 1; let y = Nat; (x, Nat) }\nfn g() {}", "stdin");
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    auto f = as<AbsNom>(as<NomStmt>(prg->stmts[0])->nom);
+    auto g = as<AbsNom>(as<NomStmt>(prg->stmts[1])->nom);
+    auto block = as<BlockExpr>(f->body());
+    auto let_x = as<LetStmt>(block->stmts[0]);
+    auto let_y = as<LetStmt>(block->stmts[1]);
+    auto add = as<InfixExpr>(let_x->init);
+    auto tup = as<TupExpr>(block->expr);
+
+    // implicit unknowns and unit tuples are shared
+    EXPECT_EQ(f->codom, comp.unk_expr());
+    EXPECT_EQ(as<IdPtrn>(let_x->ptrn)->type, comp.unk_expr());
+    EXPECT_EQ(tup->type, comp.unk_expr());
+    EXPECT_EQ(as<BlockExpr>(g->body())->expr, comp.unit_tup());
+
+    // so are equal keys and literals whose occurrences are located via the side table
+    EXPECT_EQ(add->lhs, add->rhs);
+    EXPECT_EQ(let_y->init, tup->elems[1]->expr);
+    EXPECT_EQ(comp.loc(comp.leaf_loc(add, 0)), Loc("stdin", {1, 24}, {1, 24}));
+    EXPECT_EQ(comp.loc(comp.leaf_loc(add, 1)), Loc("stdin", {1, 28}, {1, 28}));
+    EXPECT_EQ(comp.loc(comp.leaf_loc(let_y, 0)), Loc("stdin", {1, 39}, {1, 41}));
+    EXPECT_EQ(comp.loc(comp.leaf_loc(tup->elems[1], 0)), Loc("stdin", {1, 48}, {1, 50}));
+
+    // the flat form keeps them
+    auto prg2 = unflatten(comp, flatten(prg));
+    auto block2 = as<BlockExpr>(as<AbsNom>(as<NomStmt>(prg2->stmts[0])->nom)->body());
+    auto add2 = as<InfixExpr>(as<LetStmt>(block2->stmts[0])->init);
+    EXPECT_EQ(comp.leaf_loc(add2, 0), comp.leaf_loc(add, 0));
+    EXPECT_EQ(comp.leaf_loc(add2, 1), comp.leaf_loc(add, 1));
+    EXPECT_EQ(comp.leaf_loc(block2->stmts[1], 0), comp.leaf_loc(let_y, 0));
+    EXPECT_EQ(comp.leaf_loc(as<TupExpr>(block2->expr)->elems[1], 0), comp.leaf_loc(tup->elems[1], 0));
+}
+
+namespace {
+
+/// Collects the location of each UnkExpr and TupExpr in walk order - as Emitter passes them to Emitter::dbg.
+class TupLocs : public Walker<TupLocs> {
+public:
+    using Walker::exit;
+    void exit(const UnkExpr*) { locs.emplace_back(loc()); }
+    void exit(const TupExpr*) { locs.emplace_back(loc()); }
+
+    std::vector<Span> locs;
+};
+
+}
+
+TEST(Parser, LeafDbg) {
+    Comp comp;
+    auto prg = parse(comp, "fn f(a) = { }\nlet y = { let z = 1; (z, z) };", "stdin");
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    // implicit unknowns and unit tuples are located right after the token the parser made them up for
+    TupLocs tree;
+    tree.walk(prg);
+    std::vector<Loc> expected = {
+        Loc("stdin", {1,  6}, {1,  6}), // a
+        Loc("stdin", {1,  7}, {1,  7}), // codomain of f
+        Loc("stdin", {1, 13}, {1, 13}), // type of the unit tuple
+        Loc("stdin", {1, 13}, {1, 13}), // unit tuple
+        Loc("stdin", {2,  5}, {2,  5}), // y
+        Loc("stdin", {2, 15}, {2, 15}), // z
+        Loc("stdin", {2, 27}, {2, 27}), // type of (z, z)
+        Loc("stdin", {2, 22}, {2, 27}), // (z, z)
+    };
+    ASSERT_EQ(tree.locs.size(), expected.size());
+    for (size_t i = 0, e = expected.size(); i != e; ++i) EXPECT_EQ(comp.loc(tree.locs[i]), expected[i]) << i;
+
+    // the flat form and the tree rebuilt from it agree
+    auto flat = flatten(prg);
+    std::vector<Span> flat_locs;
+    for (FlatAST::Ref ref = 0, e = flat.size(); ref != e; ++ref) {
+        if (flat.node(ref) == Node::UnkExpr || flat.node(ref) == Node::TupExpr) flat_locs.emplace_back(flat.loc(ref));
+    }
+    EXPECT_EQ(flat_locs, tree.locs);
+
+    TupLocs tree2;
+    tree2.walk(unflatten(comp, flat));
+    EXPECT_EQ(tree2.locs, tree.locs);
+}
+
+TEST(Parser, Parallel) {
+    std::string text;
+    for (int i = 0; i != 500; ++i) {
+        auto n = std::to_string(i);
+        text += "fn f" + n + "(a: int) → int { let b = (a, pk(c: int; c)); if a < " + n + " { b.x } else { f(a - 1) } }\n";
+        text += "let x" + n + " = g(1.5, x, ar[int; " + n + "]);;\n";
+    }
+
+    for (auto suffix : {"", "fn h() { let y = (;\n"}) {
+        std::string expected, actual;
+        StringStream s1, s2;
+        int errors1, errors2;
+        size_t num_chunks = 0;
+        {
+            Comp comp;
+            testing::internal::CaptureStderr();
+            Parser(comp, Lexer(comp, text + suffix, "stdin").lex_all()).parse_prg()->stream(s1);
+            expected = testing::internal::GetCapturedStderr();
+            errors1 = comp.num_errors();
+        }
+        {
+            Comp comp;
+            testing::internal::CaptureStderr();
+            parse_parallel(comp, Lexer(comp, text + suffix, "stdin").lex_all(), 64, &num_chunks)->stream(s2);
+            actual = testing::internal::GetCapturedStderr();
+            errors2 = comp.num_errors();
+        }
+
+        EXPECT_EQ(s1.str(), s2.str());
+        EXPECT_EQ(expected, actual);
+        EXPECT_EQ(errors1, errors2);
+        EXPECT_EQ(errors1 != 0, *suffix != '\0');
+        // clean input is really parsed in chunks while erroneous input falls back to a serial parse
+        if (*suffix == '\0')
+            EXPECT_GT(num_chunks, 1u);
+        else
+            EXPECT_EQ(num_chunks, 1u);
+    }
+}
+
+TEST(Parser, Document) {
+    std::string text;
+    for (int i = 0; i != 300; ++i) {
+        auto n = std::to_string(i);
+        text += "fn f" + n + "(a: int) → int { let b = a * " + n + "; g(b, 1.5) }\nlet x" + n + " = f" + n + "(23);\n";
+    }
+
+    Comp comp;
+    Document doc(comp, Source(std::string(text), "doc"));
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    // the Document agrees with lexing and parsing its text from scratch
+    auto check = [&] {
+        Comp fresh;
+        testing::internal::CaptureStderr();
+        auto toks = Lexer(fresh, doc.text(), "doc").lex_all();
+        testing::internal::GetCapturedStderr();
+        ASSERT_EQ(doc.toks().size(), toks.size());
+        auto base = doc.toks().offset(toks.size() - 1) - toks.offset(toks.size() - 1);
+        for (size_t i = 0, e = toks.size(); i != e; ++i) {
+            EXPECT_EQ(doc.toks().tag(i), toks.tag(i));
+            EXPECT_EQ(doc.toks().offset(i), base + toks.offset(i));
+            EXPECT_EQ(doc.toks().finis(i), base + toks.finis(i));
+        }
+
+        StringStream s1, s2;
+        doc.prg()->stream(s1);
+        testing::internal::CaptureStderr();
+        Parser(fresh, std::move(toks)).parse_prg()->stream(s2);
+        testing::internal::GetCapturedStderr();
+        EXPECT_EQ(s1.str(), s2.str());
+    };
+
+    auto at = [&](const char* s) { return doc.text().find(s); };
+    doc.edit(at("a * 42"), 1, "b");             // rename a use
+    check();
+    EXPECT_LE(doc.num_relexed(), 2u);
+    EXPECT_EQ(doc.num_reparsed(), 1u);
+
+    doc.edit(0, 0, "\n\n");                     // move everything down
+    check();
+    EXPECT_EQ(doc.num_reparsed(), 1u);
+    auto last = doc.prg()->stmts.back();
+    EXPECT_EQ(comp.loc(last->loc).begin.row, 602u);
+
+    testing::internal::CaptureStderr();
+    doc.edit(at("let x100"), 0, "fn (");        // error in between
+    auto errs = testing::internal::GetCapturedStderr();
+    check();
+    EXPECT_NE(errs, "");
+    EXPECT_LE(doc.num_reparsed(), 3u);
+
+    doc.edit(at("fn ("), 4, "");                // fix it again
+    check();
+
+    testing::internal::CaptureStderr();
+    doc.edit(at("fn f200"), 0, "/*");           // comment out the rest
+    errs = testing::internal::GetCapturedStderr();
+    check();
+    EXPECT_NE(errs.find("non-terminated multiline comment"), std::string::npos);
+
+    doc.edit(at("fn f250"), 0, "*/");           // and only part of it
+    check();
+    doc.edit(doc.text().size(), 0, "let y = 1;");
+    check();
+    EXPECT_LE(doc.num_reparsed(), 2u);
+    doc.edit(0, doc.text().size(), "");
+    check();
+    EXPECT_TRUE(doc.prg()->stmts.empty());
+}
+
+TEST(Parser, DocumentRebase) {
+    std::string text;
+    while (text.size() < (1 << 16)) {
+        auto n = std::to_string(text.size());
+        text += "fn f" + n + "(a: int) → int { let b = a * 10; g(b, 1.5) }\n";
+    }
+
+    // many keystrokes neither exhaust the offset space nor break locations
+    Comp comp;
+    size_t space = 16 * text.size();
+    Document doc(comp, Source(std::string(text), "doc"), space);
+    auto digit = doc.text().find("a * 10", text.size() / 2) + 4;
+    size_t num_rebases = 0;
+    for (int i = 0; i != 100; ++i) {
+        doc.edit(digit, 1, std::to_string(i % 9 + 1));
+        EXPECT_LE(doc.toks().offset(doc.toks().size() - 1), space);
+        num_rebases += doc.num_relexed() == doc.toks().size();
+    }
+    EXPECT_EQ(comp.num_errors(), 0);
+    EXPECT_GE(num_rebases, 5u);
+
+    auto i = std::ranges::find_if(doc.prg()->stmts, [&](auto stmt) { return comp.loc(stmt->loc).finis.row > 1; });
+    auto body = as<BlockExpr>(as<AbsNom>(as<NomStmt>(doc.prg()->stmts[0])->nom)->body());
+    EXPECT_EQ(comp.loc(body->expr->loc), Loc("doc", {1, 39}, {1, 47}));
+    EXPECT_EQ(comp.loc((*i)->loc).begin.row, 2u);
+
+    StringStream s1, s2;
+    doc.prg()->stream(s1);
+    Comp fresh;
+    parse(fresh, doc.text(), "doc")->stream(s2);
+    EXPECT_EQ(s1.str(), s2.str());
+}
+
+TEST(Parser, Lazy) {
+    static const auto text =
+        "fn f(a: int) → int { let b = (; fn g(c: int) { c } }\n"
+        "nom n: T = { x }\n"
+        "nom m: T = { x } + 1\n"
+        "fn h(a: int) = { a }\n"
+        "let x = λ(a: int) { a };\n";
+
+    StringStream s1, s2;
+    {
+        Comp comp;
+        testing::internal::CaptureStderr();
+        Parser(comp, Lexer(comp, text, "stdin").lex_all()).parse_prg()->stream(s1);
+        testing::internal::GetCapturedStderr();
+        EXPECT_NE(comp.num_errors(), 0);
+    }
+
+    Comp comp;
+    comp.lazy = true;
+    auto prg = Parser(comp, Lexer(comp, text, "stdin").lex_all()).parse_prg();
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    // the erroneous body is only parsed on first access
+    auto f = as<AbsNom>(as<NomStmt>(prg->stmts[0])->nom);
+    testing::internal::CaptureStderr();
+    auto body = f->body();
+    auto errs = testing::internal::GetCapturedStderr();
+    EXPECT_NE(comp.num_errors(), 0);
+    EXPECT_NE(errs, "");
+    EXPECT_EQ(f->body(), body);
+
+    testing::internal::CaptureStderr();
+    prg->stream(s2);
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "");
+    EXPECT_EQ(s1.str(), s2.str());
+}
+
+TEST(Parser, Deep) {
+    static constexpr size_t n = 1'000'000;
+    Comp comp;
+
+    // mixed precedences and prefix/postfix operators still associate as before
+    StringStream s;
+    parse_expr(comp, "-a * b + c.x(1) - !d++ * e")->stream(s);
+    EXPECT_EQ(s.str(), "((((-a) * b) + c.x((1))) - ((!(d++)) * e))");
+
+    // long left-associative chain
+    std::string sum = "a";
+    for (size_t i = 1; i != n; ++i) sum += " + a";
+    size_t num = 1;
+    auto expr = parse_expr(comp, sum);
+    for (; auto infix = isa<InfixExpr>(expr); expr = infix->lhs) ++num;
+    EXPECT_EQ(num, n);
+
+    // deeply nested prefix operators
+    auto neg = std::string(n, '!') + "a";
+    num = 0;
+    expr = parse_expr(comp, neg);
+    for (; auto prefix = isa<PrefixExpr>(expr); expr = prefix->rhs) ++num;
+    EXPECT_EQ(num, n);
+
+    // long else-if ladder
+    std::string ladder;
+    for (size_t i = 0; i != n; ++i) ladder += "if a { b } else ";
+    ladder += "{ c }";
+    num = 0;
+    expr = parse_expr(comp, ladder);
+    for (; auto if_expr = isa<IfExpr>(expr); expr = if_expr->else_expr) ++num;
+    EXPECT_EQ(num, n);
+    EXPECT_EQ(comp.num_errors(), 0);
+
+
+    // deeply nested tuples and arguments
+    num = 0;
+    expr = parse_expr(comp, std::string(n, '(') + "a" + std::string(n, ')'));
+    for (; auto tup = isa<TupExpr>(expr); expr = tup->elems[0]->expr) ++num;
+    EXPECT_EQ(num, n);
+
+    std::string apps;
+    for (size_t i = 0; i != n; ++i) apps += "f(x = -";
+    apps += "a";
+    for (size_t i = 0; i != n; ++i) apps += ", b)";
+    num = 0;
+    expr = parse_expr(comp, apps);
+    for (; auto app = isa<AppExpr>(expr); expr = as<PrefixExpr>(app->arg->elems[0]->expr)->rhs) ++num;
+    EXPECT_EQ(num, n);
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    // other Expr%s nest recursively up to Comp::max_depth
+    std::string ifs;
+    for (size_t i = 0; i != 100; ++i) ifs += "if a { ";
+    ifs += "a";
+    for (size_t i = 0; i != 100; ++i) ifs += " }";
+    parse_expr(comp, ifs);
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    comp.max_depth = 50;
+    testing::internal::CaptureStderr();
+    parse_expr(comp, ifs);
+    EXPECT_NE(testing::internal::GetCapturedStderr(), "");
+    EXPECT_EQ(comp.num_errors(), 1);
+}
+
+TEST(Parser, DeepWalk) {
+    static constexpr size_t n = 1'000'000;
+    Emitter emitter;
+    auto& comp = emitter.comp;
+
+    // bind, stream, and emit a long chain and a long else-if ladder without recursion
+    std::string text = "let a = ();\nlet x = a";
+    for (size_t i = 1; i != n; ++i) text += " + a";
+    text += ";\nlet y = ";
+    for (size_t i = 0; i != n; ++i) text += "if a { a } else ";
+    text += "{ a };\n";
+
+    auto prg = parse(comp, text);
+    Scopes scopes(comp);
+    scopes.bind(prg);
+    EXPECT_EQ(comp.num_errors(), 0);
+
+    StringStream s;
+    prg->stream(s);
+    auto str = s.str();
+    EXPECT_EQ(str.find("let x: <?> = " + std::string(n - 1, '(') + "a + a) + a)"), str.find('\n') + 1);
+    size_t num = 0;
+    for (auto i = str.find("} else if a {"); i != std::string::npos; i = str.find("} else if a {", i + 1)) ++num;
+    EXPECT_EQ(num, n - 1);
+
+    emitter.emit(prg);
+    EXPECT_NE(as<IdPtrn>(as<LetStmt>(prg->stmts.front())->ptrn)->def, nullptr);
+}
+
+TEST(Parser, Streaming) {
+    static constexpr int n = 10000;
+    std::string text;
+    for (int i = 0; i != n; ++i) {
+        auto s = std::to_string(i), p = std::to_string(i == 0 ? 0 : i - 1);
+        text += "fn f" + s + "(a: Nat) → Nat { g" + s + "(x" + p + ") }\n";
+        text += "fn g" + s + "(a: Nat) → Nat { f" + s + "(a) }\n";
+        text += "let x" + s + " = f" + s + "(" + s + ");\n";
+    }
+    text += "let y = f0(x9999);\n"; // refers to released items
+    text += "let x0 = 1;\n";
+
+    Comp comp;
+    auto before = comp.mark();
+    Parser parser(comp, text, "stdin");
+    Scopes scopes(comp);
+    size_t num_stmts = 0;
+    testing::internal::CaptureStderr();
+    auto num = for_each_item(parser, scopes, [&](const Ptrs<Stmt>& item) { num_stmts += item.size(); });
+    auto errs = testing::internal::GetCapturedStderr();
+    EXPECT_EQ(num, n + 2);
+    EXPECT_EQ(num_stmts, 3 * n + 2);
+    EXPECT_LE(comp.mark().arena.num_blocks, before.arena.num_blocks + 1);
+
+    // the same diagnostics as binding the whole Prg
+    EXPECT_EQ(comp.num_errors(), 2);
+    EXPECT_NE(errs.find("stdin:1:26-1:27: error: use of undeclared identifier 'x0'"), std::string::npos);
+    EXPECT_NE(errs.find("stdin:30002:5-30002:6: error: redefinition of 'x0'"), std::string::npos);
+    EXPECT_NE(errs.find("stdin:3:5-3:6: note: previous declaration of 'x0' was here"), std::string::npos);
+}
+
+TEST(Parser, Cache) {
+    static const auto text =
+        "fn f(a: Nat) → Nat { let b = -a * 2 + 3.5; if b == 0 { () } else { f(b.x) } }\n"
+        "nom n: Type = { x }\n"
+        "let t = (a, b, (c, true, ()));\n";
+    auto path = testing::TempDir() + "dimpl_parser_cache";
+
+    StringStream s1, s2;
+    u32 begin;
+    {
+        Comp comp;
+        auto prg = parse(comp, text, "stdin");
+        EXPECT_EQ(comp.num_errors(), 0);
+        prg->stream(s1);
+        begin = prg->stmts[1]->loc.begin - comp.srcs().file(prg->loc.begin).base;
+        write_cache(comp, prg, path.c_str());
+    }
+
+    // Sym ids and the base of the File differ from the writer's
+    Comp comp;
+    comp.sym("y");
+    comp.srcs().add(Source(std::string("let y = 0;"), "other"));
+    auto& file = comp.srcs().add(Source::borrow(text, "stdin"));
+    auto prg = read_cache(comp, file, path.c_str());
+    ASSERT_NE(prg, nullptr);
+    prg->stream(s2);
+    EXPECT_EQ(s1.str(), s2.str());
+    EXPECT_EQ(prg->stmts[1]->loc.begin, file.base + begin);
+
+    // so are the locations of keys and literals
+    auto f   = as<AbsNom>(as<NomStmt>(prg->stmts[0])->nom);
+    auto add = as<InfixExpr>(as<LetStmt>(as<BlockExpr>(f->body())->stmts[0])->init);
+    auto n   = as<NomStmt>(prg->stmts[1])->nom;
+    EXPECT_EQ(comp.loc(comp.leaf_loc(add, 0)), Loc("stdin", {1, 39}, {1, 41}));
+    EXPECT_EQ(comp.loc(comp.leaf_loc(add->lhs, 0)), Loc("stdin", {1, 35}, {1, 35}));
+    EXPECT_EQ(comp.loc(comp.leaf_loc(n, 0)), Loc("stdin", {2, 8}, {2, 11}));
+
+    auto& edited = comp.srcs().add(Source(std::string(text) + "let u = t;\n", "stdin"));
+    EXPECT_EQ(read_cache(comp, edited, path.c_str()), nullptr);
+
+    // a corrupt cache is either rejected or yields some well-formed Prg
+    std::string bytes((std::istreambuf_iterator<char>(std::ifstream(path, std::ios::binary).rdbuf())), {});
+    size_t num_rejected = 0;
+    for (size_t i = 0, e = bytes.size(); i != e; ++i) {
+        auto corrupt = bytes;
+        corrupt[i] ^= 0x5a;
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << corrupt;
+        if (auto prg = read_cache(comp, file, path.c_str())) {
+            StringStream s;
+            prg->stream(s);
+        } else {
+            ++num_rejected;
+        }
+    }
+    EXPECT_GT(num_rejected, bytes.size() / 2);
+    std::remove(path.c_str());
+
+    // bodies skipped by a lazy parse count as well
+    auto file_path = testing::TempDir() + "dimpl_parser_cache.dimpl";
+    std::ofstream(file_path) << "fn f(a: Nat) → Nat { let x = ; a }\n";
+    for (int i = 0; i != 2; ++i) {
+        Comp comp;
+        comp.lazy = true;
+        testing::internal::CaptureStderr();
+        parse_file(comp, file_path.c_str(), path.c_str());
+        auto errs = testing::internal::GetCapturedStderr();
+        EXPECT_NE(errs.find("expected expression"), std::string::npos);
+        EXPECT_EQ(comp.num_errors(), 1);
+        EXPECT_FALSE(std::ifstream(path).good());
+    }
+    std::remove(file_path.c_str());
+}
+
+TEST(Parser, Recovery) {
+    static const auto text =
+        "let x = ;\n"
+        "let y = (1, 2;\n"
+        "nom n: T = { x ) + }\n"
+        "fn f(a: Nat) → Nat { a b c; let z = a; z }\n"
+        "} ) junk (junk; junk);\n"
+        "let w = 1;\n";
+
+    Comp comp;
+    testing::internal::CaptureStderr();
+    auto prg = parse(comp, text, "stdin");
+    auto errs = testing::internal::GetCapturedStderr();
+    EXPECT_EQ(comp.num_errors(), 5); // one per broken Stmt
+    EXPECT_EQ(prg->stmts.size(), 5);
+    auto f = as<AbsNom>(as<NomStmt>(prg->stmts[3])->nom);
+    EXPECT_EQ(as<BlockExpr>(f->body())->stmts.size(), 1); // parsing resumes after "b c;"
+
+    // garbage yields a bounded number of diagnostics in linear time
+    std::string garbage;
+    for (int i = 0; i != 100000; ++i) garbage += ") x ] + 1 ;\n";
+    for (auto pipeline : {false, true}) {
+        Comp comp;
+        comp.pipeline = pipeline;
+        Parser parser = pipeline ? Parser(comp, std::make_unique<LexerThread>(comp, Source::borrow(garbage, "stdin")))
+                                 : Parser(comp, Lexer(comp, garbage, "stdin").lex_all());
+        testing::internal::CaptureStderr();
+        parser.parse_prg();
+        auto errs = testing::internal::GetCapturedStderr();
+        EXPECT_EQ(comp.num_errors(), comp.max_errors);
+        EXPECT_NE(errs.find("too many errors; giving up"), std::string::npos);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef DIMPL_ARENA_H
+#define DIMPL_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dimpl {
+
+/// Bump-pointer allocator; all memory is released at once when the Arena dies or back to a Mark.
+class Arena {
+public:
+    static constexpr size_t Block_Size = 64 * 1024;
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena(Arena&& other) { swap(*this, other); }
+    Arena& operator=(Arena other) { swap(*this, other); return *this; }
+
+    /// A position to rewind to; see Arena::rewind.
+    struct Mark {
+        size_t num_blocks;
+        char* ptr;
+        char* end;
+    };
+
+    Mark mark() const { return {blocks_.size(), ptr_, end_}; }
+    /// Releases all memory allocated since @p mark was taken.
+    void rewind(Mark mark) {
+        blocks_.resize(mark.num_blocks);
+        ptr_ = mark.ptr;
+        end_ = mark.end;
+    }
+
+    void* alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+        auto p = align_up(ptr_, align);
+        if (p + size > end_) [[unlikely]] return grow(size, align);
+        ptr_ = p + size;
+        return p;
+    }
+
+    friend void swap(Arena& a, Arena& b) {
+        using std::swap;
+        swap(a.blocks_, b.blocks_);
+        swap(a.ptr_,    b.ptr_);
+        swap(a.end_,    b.end_);
+    }
+
+private:
+    static char* align_up(char* p, size_t align) {
+        return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~uintptr_t(align - 1));
+    }
+
+    void* grow(size_t size, size_t align) {
+        if (size + align > Block_Size / 4) // oversized: give it its own block and keep on bumping the current one
+            return align_up(blocks_.emplace_back(new char[size + align]).get(), align);
+
+        ptr_ = blocks_.emplace_back(new char[Block_Size]).get();
+        end_ = ptr_ + Block_Size;
+        return alloc(size, align);
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* ptr_ = nullptr;
+    char* end_ = nullptr;
+};
+
+}
+
+#endif
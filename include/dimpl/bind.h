@@ -8,6 +8,7 @@
 namespace dimpl {
 
 struct Decl;
+struct Prg;
 struct Stmt;
 struct Use;
 
@@ -26,11 +27,20 @@ public:
     void insert(const Decl*);
     void use(const Use*);
     std::optional<const Decl*> find(Sym);
+    void bind(const Prg*);
     void bind_stmts(const Ptrs<Stmt>&);
+    /**
+     * Replaces the Decl%s inserted into the outermost scope since the last call by stubs which only keep Sym, location
+     * and Def.
+     * Afterwards, the AST of these Decl%s may be released while later Stmt%s still bind to them; see for_each_item.
+     */
+    void stub_decls();
 
 private:
     Comp& comp_;
     std::vector<SymMap<const Decl*>> scopes_;
+    std::vector<const Decl*> outermost_; ///< Decl%s inserted into the outermost scope; see stub_decls
+    Arena stubs_;
 };
 
 //------------------------------------------------------------------------------
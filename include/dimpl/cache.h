@@ -0,0 +1,43 @@
+#ifndef DIMPL_CACHE_H
+#define DIMPL_CACHE_H
+
+#include <string_view>
+
+#include "dimpl/ast.h"
+
+namespace dimpl {
+
+/**
+ * Writes @p prg, which has been parsed from a single File, to @p path as a binary cache.
+ * The cache holds the FlatAST of @p prg together with a table of all identifier strings and the hash and size of the
+ * source text.
+ * A header locates each section by its offset relative to the begin of the cache.
+ * Node tags, auxiliary bytes and @c extra are stored as they are laid out in memory; Span%s and operands as varints
+ * relative to the previous Span and to their node, respectively - see cache.cpp; identifiers as indices into the
+ * string table.
+ * Hence, the cache cannot be used in place: the varints and identifiers are decoded into a FlatAST which is then
+ * unflattened into a Prg.
+ * This favors a small cache over loading without any per-node work: fixed-width operands and Span%s would about
+ * double its size.
+ * The cache uses the host's byte order and is not meant to be shared between hosts.
+ */
+void write_cache(Comp& comp, const Prg* prg, const char* path);
+/**
+ * Rebuilds the Prg cached in @p path with its Span%s pointing into @p file.
+ * The cache is mapped into memory; fixed-size sections are copied in one go, varints are decoded in a single pass, and
+ * each identifier is interned once - nothing is lexed or parsed.
+ * Yields @c nullptr if @p path is missing or malformed or has been written for another text than that of @p file;
+ * each node is checked to refer to children of the right kind before it, and each Span to lie within @p file.
+ */
+Ptr<Prg> read_cache(Comp& comp, const SourceManager::File& file, const char* path);
+/**
+ * Loads the Prg of @p file from @p cache if the cache is up to date; otherwise parses @p file and writes @p cache.
+ * Only Prg%s parsed without diagnostics are cached, since loading one does not repeat them.
+ */
+Ptr<Prg> parse_file(Comp& comp, const char* file, const char* cache);
+/// Hash of a source text as recorded in a cache.
+u64 hash_source(std::string_view text);
+
+}
+
+#endif
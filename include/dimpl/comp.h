@@ -1,10 +1,29 @@
 #ifndef DIMPL_COMP_H
 #define DIMPL_COMP_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
 #include <thorin/world.h>
 #include <thorin/debug.h>
 #include <thorin/util/types.h>
 
+#include "dimpl/arena.h"
+#include "dimpl/source.h"
+#include "dimpl/sym.h"
+
 namespace dimpl {
 
 using namespace thorin::types;
@@ -20,33 +39,66 @@ using thorin::errln;
 using thorin::outf;
 using thorin::outln;
 
-template<class T> using Ptr  = std::unique_ptr<const T>;
-template<class T> using Ptrs = std::deque<Ptr<T>>;
+struct AST;
+struct KeyExpr;
+struct LitExpr;
+struct TupExpr;
+struct UnkExpr;
 
-class Sym : public thorin::Streamable<Sym> {
+/// Non-owning: all AST nodes live in their Comp's arena; see Comp::mk.
+template<class T> using Ptr  = const T*;
+
+/// Exact-size, immutable list of child nodes in the Comp's arena; see Comp::mk_ptrs.
+template<class T>
+class Ptrs {
 public:
-    Sym() {}
-    Sym(const thorin::Def* def)
-        : def_(def)
+    Ptrs() {}
+    Ptrs(const Ptr<T>* ptrs, size_t size)
+        : ptrs_(ptrs)
+        , size_(size)
     {}
 
-    const thorin::Def* def() const { return def_; }
-    bool operator==(Sym other) const { return this->def() == other.def(); }
-    Stream& stream(Stream& s) const { return s << thorin::tuple2str(def()); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const Ptr<T>* begin() const { return ptrs_; }
+    const Ptr<T>* end() const { return ptrs_ + size_; }
+    Ptr<T> operator[](size_t i) const { assert(i < size_); return ptrs_[i]; }
+    Ptr<T> front() const { return (*this)[0]; }
+    Ptr<T> back() const { return (*this)[size_ - 1]; }
 
 private:
-    const thorin::Def* def_;
+    const Ptr<T>* ptrs_ = nullptr;
+    size_t size_ = 0;
 };
 
-struct SymHash {
-    static thorin::hash_t hash(Sym sym) { return thorin::murmur3(sym.def()->gid()); }
-    static bool eq(Sym a, Sym b) { return a == b; }
-    static Sym sentinel() { return Sym((const thorin::Def*) 1); }
-};
+/// Collects a Ptrs while parsing; the first @p N elements stay on the stack.
+template<class T, size_t N = 8>
+class PtrsBuilder {
+public:
+    PtrsBuilder() {}
+    PtrsBuilder(const PtrsBuilder&) = delete;
+    PtrsBuilder& operator=(PtrsBuilder) = delete;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    void emplace_back(Ptr<T> ptr) {
+        if (size_ < N)
+            stack_[size_] = ptr;
+        else
+            heap_.emplace_back(ptr);
+        ++size_;
+    }
+    /// Copies all elements to @p ptrs which must provide room for @c size() elements.
+    void copy(Ptr<T>* ptrs) const {
+        std::copy_n(stack_.begin(), std::min(size_, N), ptrs);
+        std::copy(heap_.begin(), heap_.end(), ptrs + N);
+    }
 
-template<class Val>
-using SymMap = thorin::HashMap<Sym, Val, SymHash>;
-using SymSet = thorin::HashSet<Sym, SymHash>;
+private:
+    std::array<Ptr<T>, N> stack_;
+    std::vector<Ptr<T>> heap_;
+    size_t size_ = 0;
+};
 
 #define DIMPL_KEY(m)            \
     m(K_Cn,        "Cn")        \
@@ -147,9 +199,11 @@ constexpr auto Num_Keys  = size_t(0) DIMPL_KEY(CODE);
     m(A_or_assign,  "|=",  "bitor_assign")  \
     m(A_xor_assign, "^=",  "bitxor_assign")
 
-class Tok : public thorin::Streamable<Sym> {
+/// Only identifiers carry an interned Sym; keywords carry the one pre-interned by Comp, all other tokens are fully
+/// described by their Tag.
+class Tok : public thorin::Streamable<Tok> {
 public:
-    enum class Tag {
+    enum class Tag : uint8_t {
 #define CODE(t, str) t,
         DIMPL_KEY(CODE)
         DIMPL_LIT(CODE)
@@ -175,34 +229,41 @@ public:
     };
 
     Tok() {}
-    Tok(Loc loc, Tag tag, Sym sym)
+    Tok(Span loc, Tag tag)
         : loc_(loc)
         , tag_(tag)
-        , sym_(sym)
     {}
-    Tok(Loc loc, s64 s)
+    Tok(Span loc, Tag tag, Sym sym)
+        : loc_(loc)
+        , tag_(tag)
+        , sym_(sym)
+    {
+        assert(tag == Tag::M_id || is_key());
+    }
+    Tok(Span loc, s64 s)
         : loc_(loc)
         , tag_(Tag::L_s)
         , s_(s)
     {}
-    Tok(Loc loc, u64 u)
+    Tok(Span loc, u64 u)
         : loc_(loc)
         , tag_(Tag::L_u)
         , u_(u)
     {}
-    Tok(Loc loc, f64 f)
+    Tok(Span loc, f64 f)
         : loc_(loc)
         , tag_(Tag::L_f)
         , f_(f)
     {}
 
     Tag tag() const { return tag_; }
-    Loc loc() const { return loc_; }
-    Sym sym() const { return sym_; }
+    Span loc() const { return loc_; }
+    Sym sym() const { assert(tag() == Tag::M_id || is_key()); return sym_; }
     thorin::f64 f() const { assert(tag() == Tag::L_f ); return f_; }
     thorin::s64 s() const { assert(tag() == Tag::L_s ); return s_; }
     thorin::u64 u() const { assert(tag() == Tag::L_u ); return u_; }
     bool isa(Tag tag) const { return tag_ == tag; }
+    bool is_key() const { return size_t(tag()) < Num_Keys; }
     bool is_lit() const;
     Stream& stream(Stream&) const;
 
@@ -211,7 +272,7 @@ public:
     static const char* tag2name(Tag );
 
 private:
-    Loc loc_;
+    Span loc_;
     Tag tag_;
     union {
         Sym sym_;
@@ -226,51 +287,189 @@ public:
     Comp(const Comp&) = delete;
     Comp(Comp&&) = delete;
     Comp& operator=(Comp) = delete;
-    Comp()
-        : anonymous_(sym("_"))
-    {}
+    Comp();
 
     bool is_anonymous(Sym sym) const { return sym == anonymous_; }
+    /// @name pre-interned Sym%s
+    /// Use these instead of Comp::sym where another thread may be interning at the same time.
+    //@{
+    Sym anonymous() const { return anonymous_; }
+    Sym error() const { return error_; }
+    //@}
 
     /// @name getters
     //@{
     int num_warnings() const { return num_warnings_; }
     int num_errors() const { return num_errors_; }
     thorin::World& world() { return world_; }
-    Sym sym(const std::string& s) { return {world().tuple_str(s)}; }
+    SourceManager& srcs() { return srcs_; }
+    /// Decodes @p span to file/row/col.
+    Loc loc(Span span) const { return srcs_.loc(span); }
+    Sym sym(std::string_view s) { return syms_.sym(s); }
+    const SymTable& syms() const { return syms_; }
+    /// Pre-interned Sym of keyword @p tag.
+    Sym key(Tok::Tag tag) const { assert(size_t(tag) < Num_Keys); return keys_[size_t(tag)]; }
+    //@}
+
+    /// Keeps @p t alive as long as the Comp - e.g. the Toks a LazyExpr refers to.
+    template<class T>
+    const T& own(T&& t) {
+        auto ptr = std::make_shared<const T>(std::move(t));
+        owned_.emplace_back(ptr);
+        return *ptr;
+    }
+
+    /// Lazily builds the Thorin string tuple of @p sym - only needed when emission wants a name as a @c Def.
+    const thorin::Def* sym2def(Sym sym) {
+        auto [i, ins] = sym2def_.emplace(sym, nullptr);
+        if (ins) i->second = world().tuple_str(std::string(sym.str()));
+        return i->second;
+    }
+
+    /// @name AST arena
+    /// All AST nodes and their Ptrs are allocated here and released at once with the Comp - no destructor ever runs.
+    //@{
+    template<class T, class... Args>
+    Ptr<T> mk(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "AST nodes are never destroyed");
+        return new (arena().alloc(sizeof(T), alignof(T))) T(*this, std::forward<Args>(args)...);
+    }
+    template<class T, size_t N>
+    Ptrs<T> mk_ptrs(const PtrsBuilder<T, N>& builder) {
+        if (builder.empty()) return {};
+        auto ptrs = static_cast<Ptr<T>*>(arena().alloc(builder.size() * sizeof(Ptr<T>), alignof(Ptr<T>)));
+        builder.copy(ptrs);
+        return {ptrs, builder.size()};
+    }
+    template<class T>
+    Ptrs<T> mk_ptrs(std::span<const Ptr<T>> elems) {
+        if (elems.empty()) return {};
+        auto ptrs = static_cast<Ptr<T>*>(arena().alloc(elems.size() * sizeof(Ptr<T>), alignof(Ptr<T>)));
+        std::ranges::copy(elems, ptrs);
+        return {ptrs, elems.size()};
+    }
+
+    /// Position of the current thread's Arena and of the leaf locations; see Comp::rewind.
+    struct Mark {
+        Arena::Mark arena;
+        size_t num_leaf_locs;
+    };
+    Mark mark();
+    /**
+     * Releases all AST nodes and Ptrs the current thread made since @p mark - e.g. a top-level item that has been
+     * compiled; see for_each_item.
+     * None of them may be used anymore and no other thread may make AST nodes meanwhile.
+     */
+    void rewind(Mark mark);
+
+    /// While alive, Comp::mk of the current thread allocates from a separate Arena which the Comp keeps until it dies.
+    class LocalArena {
+    public:
+        LocalArena(const LocalArena&) = delete;
+        LocalArena& operator=(LocalArena) = delete;
+        LocalArena(Comp& comp)
+            : prev_(arena_)
+        {
+            std::lock_guard<std::mutex> guard(comp.arenas_mutex_);
+            arena_ = &comp.arenas_.emplace_back();
+        }
+        ~LocalArena() { arena_ = prev_; }
+
+    private:
+        Arena* prev_;
+    };
+    //@}
+
+    /**
+     * @name canonical leaves
+     * Immutable leaves shared by all their occurrences.
+     * They have no location themselves; the locations of their occurrences are kept in a side table - see Comp::leaf_loc.
+     * An implicit unknown or unit tuple is located at the token after which the parser made it up.
+     * All but the LitExpr%s are made up front; Comp::lit_expr and Comp::set_leaf_locs may be called from several threads.
+     * The leaves live in an Arena of their own which Comp::rewind leaves alone.
+     */
+    //@{
+    Ptr<UnkExpr> unk_expr() const { return unk_expr_; }
+    Ptr<TupExpr> unit_tup() const { return unit_tup_; }
+    Ptr<KeyExpr> key_expr(Tok::Tag tag) const { assert(size_t(tag) < Num_Keys); return key_exprs_[size_t(tag)]; }
+    Ptr<LitExpr> lit_expr(Tok);
+    /// Is @p ast one of the canonical leaves above?
+    bool is_leaf(const AST* ast) const;
+    /// Records the locations of the canonical leaf children of @p parent in constructor argument order.
+    void set_leaf_locs(const AST* parent, std::span<const Span> locs);
+    /// Location of the @p i-th canonical leaf child of @p parent in constructor argument order or @c Span() if none has been recorded.
+    Span leaf_loc(const AST* parent, size_t i) const;
+    bool has_leaf_locs(const AST* parent) const;
     //@}
 
     /// @name err/warn/note
     //@{
     template<class... Args>
-    auto err(const char* fmt, Args&&... args) {
-        ++num_errors_;
-        return errln(fmt, std::forward<Args&&>(args)...);
+    void err(const char* fmt, Args&&... args) {
+        if (capture_) ++capture_->num_errors; else ++num_errors_;
+        diagln(fmt, std::forward<Args&&>(args)...);
     }
     template<class... Args>
-    auto warn(const char* fmt, Args&&... args) {
-        ++num_warnings_;
-        return errln(fmt, std::forward<Args&&>(args)...);
+    void warn(const char* fmt, Args&&... args) {
+        if (capture_) ++capture_->num_warnings; else ++num_warnings_;
+        diagln(fmt, std::forward<Args&&>(args)...);
     }
     template<class... Args>
-    auto note(const char* fmt, Args&&... args) {
-        return errln(fmt, std::forward<Args&&>(args)...);
+    void note(const char* fmt, Args&&... args) {
+        diagln(fmt, std::forward<Args&&>(args)...);
     }
 
     template<class... Args>
-    auto err(Loc loc, const char* fmt, Args&&... args) {
-        errf("{}: error: ", loc);
-        return err(fmt, std::forward<Args&&>(args)...);
+    void err(Loc loc, const char* fmt, Args&&... args) {
+        diagf("{}: error: ", loc);
+        err(fmt, std::forward<Args&&>(args)...);
     }
     template<class... Args>
-    auto warn(Loc loc, const char* fmt, Args&&... args) {
-        errf("{}: warning: ", loc);
-        return err(fmt, std::forward<Args&&>(args)...);
+    void warn(Loc loc, const char* fmt, Args&&... args) {
+        diagf("{}: warning: ", loc);
+        warn(fmt, std::forward<Args&&>(args)...);
     }
     template<class... Args>
-    auto note(Loc loc, const char* fmt, Args&&... args) {
-        errf("{}: note: ", loc);
-        return err(fmt, std::forward<Args&&>(args)...);
+    void note(Loc loc, const char* fmt, Args&&... args) {
+        diagf("{}: note: ", loc);
+        note(fmt, std::forward<Args&&>(args)...);
+    }
+
+    template<class... Args>
+    void err(Span span, const char* fmt, Args&&... args) { err(loc(span), fmt, std::forward<Args&&>(args)...); }
+    template<class... Args>
+    void warn(Span span, const char* fmt, Args&&... args) { warn(loc(span), fmt, std::forward<Args&&>(args)...); }
+    template<class... Args>
+    void note(Span span, const char* fmt, Args&&... args) { note(loc(span), fmt, std::forward<Args&&>(args)...); }
+
+    /// Diagnostics that have been held back by a Capture.
+    struct Diags {
+        std::string text;
+        int num_errors   = 0;
+        int num_warnings = 0;
+    };
+
+    /// While alive, diagnostics of the current thread are collected in a Diags instead of being printed and counted.
+    class Capture {
+    public:
+        Capture(const Capture&) = delete;
+        Capture& operator=(Capture) = delete;
+        Capture(Diags& diags)
+            : prev_(capture_)
+        {
+            capture_ = &diags;
+        }
+        ~Capture() { capture_ = prev_; }
+
+    private:
+        Diags* prev_;
+    };
+
+    /// Prints and counts @p diags previously collected by a Capture.
+    void flush(const Diags& diags) {
+        if (!diags.text.empty()) diagf("{}", diags.text);
+        num_errors_   += diags.num_errors;
+        num_warnings_ += diags.num_warnings;
     }
     //@}
 
@@ -279,13 +478,68 @@ public:
     bool fancy       = false;
     bool emit_ast    = false;
     bool emit_thorin = false;
+    bool pipeline    = false; ///< lex on a separate thread while parsing; see LexerThread
+    bool lazy        = false; ///< skip brace-delimited bodies of Nom%s while parsing; see LazyExpr
+    bool streaming   = false; ///< compile one top-level item at a time and release it afterwards; see for_each_item
+    bool flat        = false; ///< parse into a FlatAST, and bind and emit that; see Parser::parse_flat_prg
+    int  max_errors  = 20;    ///< each Lexer and Parser gives up after this many errors; 0 for no limit
+    int  max_depth   = 4096;  ///< nesting of Expr%s the Parser descends into recursively; 0 for no limit
     //@}
 
 private:
+    template<class... Args>
+    void diagf(const char* fmt, Args&&... args) {
+        if (capture_) {
+            StringStream s;
+            s.fmt(fmt, std::forward<Args&&>(args)...);
+            capture_->text.append(s.str());
+        } else {
+            errf(fmt, std::forward<Args&&>(args)...);
+        }
+    }
+    template<class... Args>
+    void diagln(const char* fmt, Args&&... args) {
+        diagf(fmt, std::forward<Args&&>(args)...);
+        diagf("\n");
+    }
+
+    Arena& arena() { return arena_ ? *arena_ : ast_arena_; }
+    template<class T, class... Args>
+    Ptr<T> mk_canonical(Args&&... args) {
+        return new (leaf_arena_.alloc(sizeof(T), alignof(T))) T(*this, std::forward<Args>(args)...);
+    }
+    const Span* find_leaf_locs(const AST* parent) const; ///< needs leaves_mutex_
+
+    static inline thread_local Diags* capture_ = nullptr;
+    static inline thread_local Arena* arena_ = nullptr; ///< see LocalArena
+
     thorin::World world_;
-    int num_warnings_ = 0;
-    int num_errors_ = 0;
+    Arena ast_arena_;
+    Arena leaf_arena_; ///< of the canonical leaves
+    std::deque<Arena> arenas_; ///< of all LocalArena%s
+    std::mutex arenas_mutex_;
+    Ptr<UnkExpr> unk_expr_ = nullptr;
+    Ptr<TupExpr> unit_tup_ = nullptr;
+    std::array<Ptr<KeyExpr>, Num_Keys> key_exprs_ = {};
+    mutable std::mutex leaves_mutex_; ///< guards lit_exprs_ and the leaf locations
+    std::array<std::unordered_map<u64, Ptr<LitExpr>>, 3> lit_exprs_; ///< by bits; for L_f, L_s and L_u
+    struct LeafLocs {
+        const AST* parent;
+        u32 begin; ///< into leaf_locs_
+    };
+    /// Appended by Comp::set_leaf_locs; the first leaf_locs_sorted_ of them are sorted by parent - the rest is merged in on lookup.
+    mutable std::vector<LeafLocs> leaf_locs_begin_;
+    mutable size_t leaf_locs_sorted_ = 0;
+    std::vector<Span> leaf_locs_;
+    SourceManager srcs_;
+    SymTable syms_;
+    SymMap<const thorin::Def*> sym2def_;
+    std::vector<std::shared_ptr<const void>> owned_;
+    std::atomic<int> num_warnings_ = 0;
+    std::atomic<int> num_errors_ = 0;
     Sym anonymous_;
+    Sym error_;
+    std::array<Sym, Num_Keys> keys_;
 };
 
 inline std::ostream& operator<<(std::ostream& o, Tok::Tag tag) { return o << Tok::tag2str(tag); }
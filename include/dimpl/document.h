@@ -0,0 +1,77 @@
+#ifndef DIMPL_DOCUMENT_H
+#define DIMPL_DOCUMENT_H
+
+#include <string_view>
+#include <vector>
+
+#include "dimpl/ast.h"
+#include "dimpl/lexer.h"
+
+namespace dimpl {
+
+/**
+ * A source file that is edited over time - e.g. in an editor - and kept lexed and parsed incrementally.
+ * After an edit, the Lexer only runs from the damaged region on until the Tok stream resynchronizes with the previous
+ * one.
+ * Then, the Parser only runs over the top-level Stmt%s around the damage until the Stmt boundaries resynchronize; all
+ * other Stmt%s are reused as they are.
+ * Their Span%s still point into the previous version and are decoded in the latest one; see SourceManager::edit.
+ * Diagnostics are only emitted for the parts lexed or parsed again.
+ * As each version takes up its own offset range, the Document is lexed and parsed from scratch once its versions take
+ * up more than a given space; this releases all previous versions via SourceManager::rebase.
+ */
+class Document {
+public:
+    Document(const Document&) = delete;
+    Document& operator=(Document) = delete;
+    /// Lexes and parses @p src from scratch; all versions may take up @p space bytes of offset space before a rebase.
+    Document(Comp& comp, Source&& src, size_t space = 1 << 28);
+
+    /**
+     * Replaces @p removed bytes at @p offset with @p inserted and yields the new Prg.
+     * After a rebase, Span%s of previous Prg%s may not be decoded anymore.
+     */
+    Ptr<Prg> edit(size_t offset, size_t removed, std::string_view inserted);
+
+    /// @name getters
+    //@{
+    Comp& comp() { return comp_; }
+    std::string_view text() const { return file_->src.text(); }
+    const Toks& toks() const { return toks_; }
+    Ptr<Prg> prg() const { return prg_; }
+    size_t num_relexed() const { return num_relexed_; }   ///< Tok%s lexed by the last edit
+    size_t num_reparsed() const { return num_reparsed_; } ///< top-level Stmt%s parsed by the last edit
+    //@}
+
+private:
+    /// A top-level Stmt and its Tok%s <tt>[begin, end)</tt> including the semicolons and junk in front of it.
+    struct Range {
+        Ptr<Stmt> stmt;
+        size_t begin;
+        size_t end;
+    };
+
+    /**
+     * Keeps the first @p num_kept Range%s of @p old and parses from there on.
+     * Tok @p resync of @p old is now Tok @p damage_end.
+     * Once the Parser is there or past it and at the begin of a Range of @p old, this and all following Range%s of
+     * @p old are taken over.
+     */
+    void parse(const std::vector<Range>& old, size_t num_kept, size_t damage_end, size_t resync);
+
+    static constexpr size_t Window = 1024; ///< bytes lexed behind an edit before looking further
+
+    Comp& comp_;
+    size_t space_;
+    Toks toks_;
+    const SourceManager::File* first_; ///< the oldest version still in use
+    const SourceManager::File* file_;
+    std::vector<Range> stmts_;
+    Ptr<Prg> prg_ = nullptr;
+    size_t num_relexed_ = 0;
+    size_t num_reparsed_ = 0;
+};
+
+}
+
+#endif
@@ -1,22 +1,95 @@
 #ifndef DIMPL_EMIT_H
 #define DIMPL_EMIT_H
 
-#include "dimpl/comp.h"
+#include <vector>
 
-namespace dimpl {
+#include "dimpl/ast.h"
+#include "dimpl/walk.h"
 
-struct Stmt;
+namespace dimpl {
 
-class Emitter : public thorin::World {
+/**
+ * Emits thorin code in one walk; see Walker.
+ * Each Expr leaves its Def on a value stack on @c exit, where its parent picks it up.
+ * A Ptrn receives the Def it destructs on top of this stack from its parent, which also pops it again.
+ */
+class Emitter : public thorin::World, public Walker<Emitter> {
 public:
     Emitter() {}
 
     thorin::World& world() { return comp.world(); }
+    void emit(const Prg*);
     void emit_stmts(const Ptrs<Stmt>&);
-    const thorin::Def* dbg(Loc);
+    const thorin::Def* dbg(Span);
 
     thorin::Def* mem = nullptr;
     Comp comp;
+
+private:
+    /// Calls emit_nom for the run of NomStmt%s starting at @p i - if @p i starts one.
+    void emit_noms(const Ptrs<Stmt>& stmts, size_t i);
+    void emit_nom(const Nom*);
+    void emit_nom(const NomNom*);
+    void emit_nom(const AbsNom*);
+    void emit_nom(const SigNom*);
+
+    const thorin::Def* pop() {
+        auto def = defs_.back();
+        defs_.pop_back();
+        return def;
+    }
+
+    /// @name hooks
+    //@{
+    using Walker::enter;
+    using Walker::child;
+    using Walker::exit;
+
+    bool enter(const IdPtrn*);
+    bool enter(const NomStmt*);
+
+    const AST* child(const Prg*,       size_t);
+    const AST* child(const TupPtrn*,   size_t);
+    const AST* child(const LetStmt*,   size_t);
+    const AST* child(const AbsExpr*,   size_t);
+    const AST* child(const ArExpr*,    size_t);
+    const AST* child(const BlockExpr*, size_t);
+    const AST* child(const ForExpr*,   size_t);
+    const AST* child(const PkExpr*,    size_t);
+    const AST* child(const PiExpr*,    size_t);
+    const AST* child(const SigExpr*,   size_t);
+    const AST* child(const WhileExpr*, size_t);
+
+    void exit(const AssignStmt*);
+    void exit(const ExprStmt*);
+    void exit(const LetStmt*);
+    void exit(const AbsExpr*);
+    void exit(const TupExpr*);
+    void exit(const AppExpr*);
+    void exit(const BottomExpr*);
+    void exit(const ErrExpr*);
+    void exit(const FieldExpr*);
+    void exit(const ForExpr*);
+    void exit(const IdExpr*);
+    void exit(const IfExpr*);
+    void exit(const InfixExpr*);
+    void exit(const LitExpr*);
+    void exit(const MatchExpr*);
+    void exit(const PkExpr*);
+    void exit(const PiExpr*);
+    void exit(const PrefixExpr*);
+    void exit(const PostfixExpr*);
+    void exit(const KeyExpr*);
+    void exit(const ArExpr*);
+    void exit(const SigExpr*);
+    void exit(const UnkExpr*);
+    void exit(const VarExpr*);
+    void exit(const WhileExpr*);
+    //@}
+
+    std::vector<const thorin::Def*> defs_;
+
+    friend class Walker<Emitter>;
 };
 
 }
@@ -0,0 +1,141 @@
+#ifndef DIMPL_FLAT_H
+#define DIMPL_FLAT_H
+
+#include <span>
+#include <vector>
+
+#include "dimpl/ast.h"
+
+namespace dimpl {
+
+class Emitter;
+
+/**
+ * Flat layout of an AST: nodes live in parallel vectors and are addressed by 32-bit indices.
+ * Each node has a tag from DIMPL_NODE, a Span, an auxiliary byte - a Tok::Tag or a flag - and two 32-bit operands
+ * @c lhs and @c rhs.
+ * Nodes with more than two operands and all child lists keep them in @c extra.
+ * A list is the index of its length in @c extra; the elements follow.
+ * Identifiers are stored as Sym::id.
+ * Canonical leaves carry the location of their occurrence - see Comp::leaf_loc; the canonical unit tuple is flagged.
+ * Children always precede their parent; the Prg is the last node.
+ * Parser::parse_flat_prg builds a FlatAST directly, one top-level Stmt at a time, without keeping the whole tree.
+ *
+ * | node                                           | aux      | lhs                          | rhs          |
+ * |------------------------------------------------|----------|------------------------------|--------------|
+ * | Id                                             |          | Sym::id                      |              |
+ * | Prg, SigBndr, SigExpr                          |          | list                         |              |
+ * | NomNom                                         |          | extra: id, type, body        |              |
+ * | AbsNom                                         | Tok::Tag | extra: id, doms, codom, body |              |
+ * | SigNom, IdExpr, VarExpr                        |          | id                           |              |
+ * | IdBndr                                         |          | id                           | type         |
+ * | IdPtrn                                         | mut      | id                           | type         |
+ * | TupPtrn                                        | delims   | list                         |              |
+ * | ExprStmt, NomStmt, AbsExpr                     |          | child                        |              |
+ * | LetStmt                                        |          | ptrn                         | init         |
+ * | AssignStmt, InfixExpr                          | Tok::Tag | lhs                          | rhs          |
+ * | TupElem                                        |          | id                           | expr         |
+ * | TupExpr                                        | unit     | list                         | type         |
+ * | AppExpr                                        | Tok::Tag | callee                       | arg          |
+ * | BlockExpr                                      |          | list                         | expr         |
+ * | FieldExpr                                      |          | lhs                          | id           |
+ * | ForExpr                                        |          | extra: ptrn, expr, body      |              |
+ * | IfExpr                                         |          | extra: cond, then, else      |              |
+ * | LitExpr                                        | Tok::Tag | low 32 bits                  | high 32 bits |
+ * | PkExpr, ArExpr                                 |          | list                         | body         |
+ * | PiExpr                                         | Tok::Tag | list                         | codom        |
+ * | PrefixExpr, PostfixExpr                        | Tok::Tag | operand                      |              |
+ * | KeyExpr                                        | Tok::Tag |                              |              |
+ * | ErrBndr, ErrPtrn, BottomExpr, ErrExpr, UnkExpr |          |                              |              |
+ * | WhileExpr                                      |          | cond                         | body         |
+ */
+class FlatAST {
+public:
+    static_assert(Num_Nodes <= 256, "node tags are stored as u8");
+
+    using Ref = u32;                           ///< index of a node
+    static constexpr Ref None = Ref(-1);       ///< absent child such as the codomain of a @c Cn
+
+    struct Data {
+        u32 lhs;
+        u32 rhs;
+    };
+
+    /// @name getters
+    //@{
+    size_t size() const { return nodes_.size(); }
+    Ref root() const { return Ref(size() - 1); }
+    int node(Ref ref) const { return nodes_[ref]; }
+    u8 aux(Ref ref) const { return aux_[ref]; }
+    Tok::Tag tag(Ref ref) const { return Tok::Tag(aux_[ref]); }
+    Span loc(Ref ref) const { return locs_[ref]; }
+    u32 lhs(Ref ref) const { return data_[ref].lhs; }
+    u32 rhs(Ref ref) const { return data_[ref].rhs; }
+    u32 extra(u32 i) const { return extra_[i]; }
+    std::span<const Ref> list(u32 list) const { return {extra_.data() + list + 1, extra_[list]}; }
+    /// The Id of a declaring node.
+    Ref decl_id(Ref ref) const;
+    //@}
+
+private:
+    Ref add(int node, Span loc, u8 aux = 0, u32 lhs = 0, u32 rhs = 0);
+
+    std::vector<u8> nodes_;
+    std::vector<u8> aux_;
+    std::vector<Span> locs_;
+    std::vector<Data> data_;
+    std::vector<u32> extra_;
+
+    friend class Flattener;
+    friend class Cache;
+};
+
+/// Appends trees to a FlatAST; each tree may be released once flattened.
+class Flattener {
+public:
+    using Ref = FlatAST::Ref;
+
+    /// Appends the tree rooted at @p ast which is no Prg; see Flattener::finish.
+    Ref flatten(const AST* ast);
+    /// Adds the Prg of the top-level @p stmts flattened so far and hands the FlatAST over.
+    FlatAST finish(Span loc, std::span<const Ref> stmts);
+
+private:
+    Ref flatten(const AST*, Span loc);
+    Ref add(int node, Span loc, u8 aux = 0, u32 lhs = 0, u32 rhs = 0) { return flat_.add(node, loc, aux, lhs, rhs); }
+    Ref add(int node, Span loc, Tok::Tag tag, u32 lhs = 0, u32 rhs = 0) { return add(node, loc, u8(tag), lhs, rhs); }
+    u32 extra(std::initializer_list<u32> ops);
+    u32 list(std::span<const Ref> refs);
+    template<class T> u32 list(const Ptrs<T>& ptrs);
+
+    FlatAST flat_;
+    std::vector<Ref> stack_;
+    struct Parent {
+        const AST* ast;
+        Span loc;          ///< of this occurrence of @c ast
+        size_t num_leaves; ///< canonical leaf children flattened so far; see Comp::leaf_loc
+    };
+    /// Ancestors of the node being flattened.
+    std::vector<Parent> parents_;
+};
+
+/// Converts the tree rooted at @p prg.
+FlatAST flatten(const Prg* prg);
+/// Rebuilds the tree in @p comp's arena; @p comp must own the Sym%s referenced by @p flat.
+Ptr<Prg> unflatten(Comp& comp, const FlatAST& flat);
+
+/**
+ * Binds identifiers of @p flat just like Scopes::bind does for the tree and emits the same diagnostics.
+ * Yields for each node its declaring node if it is an IdExpr or VarExpr and FlatAST::None otherwise.
+ */
+std::vector<FlatAST::Ref> bind(Comp& comp, const FlatAST& flat);
+
+/**
+ * Emits @p flat just like Emitter::emit does for the tree; @p decls are the result of bind.
+ * Yields for each node its Def if it is an IdPtrn and @c nullptr otherwise - the Decl::def of the tree.
+ */
+std::vector<const thorin::Def*> emit(Emitter& emitter, const FlatAST& flat, const std::vector<FlatAST::Ref>& decls);
+
+}
+
+#endif
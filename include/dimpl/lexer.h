@@ -1,51 +1,188 @@
 #ifndef DIMPL_LEXER_H
 #define DIMPL_LEXER_H
 
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
 #include <thorin/debug.h>
 
 #include "dimpl/comp.h"
+#include "dimpl/ring.h"
+#include "dimpl/source.h"
 
 namespace dimpl {
 
+/**
+ * All Tok%s of an input in structure-of-arrays layout, as produced by Lexer::lex_all.
+ * The hot arrays are the Tok::Tag%s (one byte each), the begin offsets and the payload indices.
+ * The end offsets are kept in a separate, cold array and are only touched when a Tok is reassembled.
+ */
+class Toks {
+public:
+    Toks(Comp& comp)
+        : comp_(&comp)
+    {}
+
+    size_t size() const { return tags_.size(); }
+    Tok::Tag tag(size_t i) const { return tags_[i]; }
+    /// Offset of the @p i%th Tok's first byte in the SourceManager.
+    u32 offset(size_t i) const { return offsets_[i]; }
+    /// Offset one past the @p i%th Tok's last byte.
+    u32 finis(size_t i) const { return finis_[i]; }
+    /// Reassembles the @p i%th Tok.
+    Tok operator[](size_t i) const;
+    void push_back(const Tok& tok);
+    void pop_back();
+    /// Appends all of @p other.
+    void append(const Toks& other);
+    /// Appends <tt>[begin, end)</tt> of @p other moved by @p shift bytes (modulo 2^32) in the SourceManager.
+    void append(const Toks& other, size_t begin, size_t end, u32 shift);
+
+private:
+    Comp* comp_;
+    std::vector<Tok::Tag> tags_;
+    std::vector<u32> offsets_;
+    std::vector<u32> payloads_; ///< Sym::id for Tok::Tag::M_id, index into @p lits_ for literals, unused otherwise
+    std::vector<u64> lits_;     ///< bit patterns of the literals
+    std::vector<u32> finis_;
+};
+
+/// Lexes a contiguous buffer; token text is a span into this buffer and only copied when interned as a @p Sym.
 class Lexer {
 public:
-    Lexer(Comp& comp, std::istream&, const char* filename);
+    /// Hands @p src over to the Comp's SourceManager and lexes it from there.
+    Lexer(Comp& comp, Source&& src);
+    /// Copies @p text into a Source owned by the Comp's SourceManager; see Source::borrow to avoid the copy.
+    Lexer(Comp& comp, std::string_view text, const char* filename);
+    /// Reads @p is entirely into a buffer owned by the Comp's SourceManager.
+    Lexer(Comp& comp, std::istream& is, const char* filename);
+    /**
+     * Only lexes the chunk <tt>[begin, end)</tt> of @p file which must start outside of any token or line comment -
+     * e.g. at the begin of a line; see lex_parallel.
+     * If @p in_comment, the chunk starts within a multiline comment.
+     * A multiline comment that is still open at @p end is no error but reported by @c ends_in_comment().
+     * Gives up after @p max_errors errors - those left of Comp::max_errors when the chunk is not the first one.
+     */
+    Lexer(Comp& comp, const SourceManager::File& file, size_t begin, size_t end, bool in_comment, int max_errors);
 
     Tok lex(); ///< Get next \p Tok in stream.
+    Toks lex_all(); ///< Lexes everything up to and including Tok::Tag::M_eof.
     Comp& comp() { return comp_; }
+    /// Is the input valid utf-8 and are there less than Comp::max_errors errors? Otherwise, only a prefix is lexed.
+    bool valid() const { return valid_; }
+    /// Errors counted towards Comp::max_errors so far.
+    int num_errors() const { return num_errors_; }
+
+    /// @name chunks
+    //@{
+    bool ends_in_comment() const { return ends_in_comment_; }
+    /// Offset of the "/*" opening the comment if @c ends_in_comment() or @c std::nullopt if it is before the chunk.
+    std::optional<u32> comment_begin() const { return comment_begin_; }
+    //@}
 
 private:
-    Tok tok(Tok::Tag tag) { return {loc_, tag, comp().sym(str_)}; }
-    bool eof() const { return stream_.eof(); }
+    void init(const SourceManager::File& file, size_t begin, size_t end);
+    Span span(const char* begin, const char* finis) const { return {base_ + u32(begin - begin_), base_ + u32(finis - begin_)}; }
+    /// Span of the current token so far.
+    Span span() const { return span(tok_ptr_, peek_ptr_); }
+    Tok tok(Tok::Tag tag) { return {span(), tag}; }
+    bool eof() const { return peek_ptr_ == end_; }
     void eat_comments();
     Tok parse_literal();
 
+    /// Reports an error and gives up after Comp::max_errors of them.
+    template<class... Args>
+    void err(Span span, const char* fmt, Args&&... args) {
+        comp().err(span, fmt, std::forward<Args&&>(args)...);
+        if (++num_errors_ == max_errors_) give_up();
+    }
+    /// Pretends the input ends right here.
+    void give_up();
+
     template <typename Pred>
-    bool accept_if(Pred pred, bool append = true) {
+    bool accept_if(Pred pred) {
         if (pred(peek())) {
-            if (append) str_.append(peek_bytes_);
             next();
             return true;
         }
         return false;
     }
 
-    bool accept(uint32_t val, bool append = true) {
-        return accept_if([val] (uint32_t p) { return p == val; }, append);
+    bool accept(uint32_t val) {
+        return accept_if([val] (uint32_t p) { return p == val; });
     }
 
+    /// Accepts the multi-byte utf-8 sequence @p utf8 without decoding it.
+    bool accept(std::string_view utf8) {
+        if (peek_str() != utf8) return false;
+        next();
+        return true;
+    }
+
+    /// Consumes @c peek() and advances to the next code point.
+    /// @c peek() is the byte itself for ASCII and the lead byte of a multi-byte sequence otherwise.
     uint32_t next();
+    /// Consumes everything before @p to in bulk.
+    void skip_to(const char* to);
     uint32_t peek() const { return peek_; }
-    const std::string& str() const { return str_; }
+    std::string_view peek_str() const { return {peek_ptr_, size_t(ptr_ - peek_ptr_)}; }
+    /// Text of the current token so far.
+    std::string_view str() const { return {tok_ptr_, size_t(peek_ptr_ - tok_ptr_)}; }
 
     Comp& comp_;
-    std::istream& stream_;
+    const char* begin_    = nullptr;
+    const char* ptr_      = nullptr; ///< one past @c peek()
+    const char* peek_ptr_ = nullptr; ///< begin of @c peek()
+    const char* tok_ptr_  = nullptr; ///< begin of the current token
+    const char* end_      = nullptr;
+    u32 base_ = 0;                   ///< offset of @c begin_ in the SourceManager
     uint32_t peek_ = 0;
-    char peek_bytes_[5] = {0, 0, 0, 0, 0};
-    std::string str_;
-    Loc loc_;
-    Pos peek_pos_;
-    std::array<std::pair<Tok::Tag, Sym>, Num_Keys> keys_;
+    bool valid_ = true;
+    int num_errors_ = 0;
+    int max_errors_;
+    bool chunk_ = false;
+    bool ends_in_comment_ = false;
+    std::optional<u32> comment_begin_;
+};
+
+/**
+ * Splits @p src into chunks of about @p chunk_size bytes at line begins and lexes them in parallel.
+ * Each chunk is lexed speculatively as if it did not start within a multiline comment and with all of Comp::max_errors
+ * to spend; chunks for which this turns out to be wrong are lexed again afterwards.
+ * Yields the same Toks and diagnostics as Lexer::lex_all.
+ */
+Toks lex_parallel(Comp& comp, Source&& src, size_t chunk_size = 1 << 20);
+/// Same as above for a @p file that is already in the Comp's SourceManager.
+Toks lex_parallel(Comp& comp, const SourceManager::File& file, size_t chunk_size = 1 << 20);
+
+/**
+ * Runs a Lexer on its own thread so lexing overlaps with parsing.
+ * Tok%s are handed over through a Ring together with the diagnostics the Lexer emitted while lexing them.
+ * These diagnostics are printed when the Tok is consumed, so they appear in the same order as with a plain Lexer.
+ * While the thread runs, only the Lexer may intern Sym%s.
+ */
+class LexerThread {
+public:
+    LexerThread(Comp& comp, Source&& src);
+    ~LexerThread();
+
+    Tok lex(); ///< Same as Lexer::lex.
+
+private:
+    struct Slot {
+        Tok tok;
+        Comp::Diags diags;
+    };
+
+    Comp& comp_;
+    Lexer lexer_;
+    Ring<Slot, 1024> ring_;
+    Tok eof_;
+    bool done_ = false;
+    std::thread thread_;
 };
 
 }
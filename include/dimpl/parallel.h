@@ -0,0 +1,35 @@
+#ifndef DIMPL_PARALLEL_H
+#define DIMPL_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace dimpl {
+
+/// Invokes @p f(i) for all @p i in <tt>[0, n)</tt> on up to @c std::thread::hardware_concurrency() threads.
+/// Indices are handed out dynamically, so uneven work per index balances out.
+template<class F>
+void parallel_for(size_t n, F f) {
+    size_t num_threads = std::min<size_t>(n, std::max(1u, std::thread::hardware_concurrency()));
+    if (num_threads <= 1) {
+        for (size_t i = 0; i != n; ++i) f(i);
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n;) f(i);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t != num_threads; ++t) threads.emplace_back(work);
+    work();
+    for (auto& thread : threads) thread.join();
+}
+
+}
+
+#endif
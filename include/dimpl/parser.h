@@ -1,9 +1,13 @@
 #ifndef DIMPL_PARSER_H
 #define DIMPL_PARSER_H
 
+#include <algorithm>
 #include <array>
+#include <memory>
+#include <optional>
 
 #include "dimpl/ast.h"
+#include "dimpl/flat.h"
 #include "dimpl/lexer.h"
 
 namespace dimpl {
@@ -21,26 +25,48 @@ class Parser {
 private:
     class Tracker {
     public:
-        Tracker(Parser& parser, const Pos& pos)
+        Tracker(Parser& parser, u32 begin)
             : parser_(parser)
-            , pos_(pos)
+            , begin_(begin)
         {}
 
-        operator Loc() const { return {parser_.prev_.file, pos_, parser_.prev_.finis}; }
+        u32 begin() const { return begin_; }
+        operator Span() const { return {begin_, parser_.prev_.finis}; }
 
     private:
         Parser& parser_;
-        Pos pos_;
+        u32 begin_;
     };
 
 public:
+    static constexpr int max_ahead = 3; ///< maximum lookahead
+
     Parser(Comp&, std::istream&, const char* file);
+    /// Copies the text; see Lexer.
+    Parser(Comp&, std::string_view, const char* file);
+    /// Lexes @p src on demand.
+    Parser(Comp&, Source&& src);
+    /// Parses @p toks lexed up front by Lexer::lex_all; the lookahead is then just an index into @p toks.
+    Parser(Comp&, Toks&& toks);
+    /**
+     * Only parses <tt>[begin, end)</tt> of @p toks which must outlive the Parser; @p end acts as Tok::Tag::M_eof.
+     * If @p lazy, bodies are skipped as with Comp::lazy and @p toks must live as long as the Comp.
+     */
+    Parser(Comp&, const Toks& toks, size_t begin, size_t end, bool lazy = false);
+    /// Parses while @p lexer_thread lexes ahead.
+    Parser(Comp&, std::unique_ptr<LexerThread>&& lexer_thread);
 
-    Comp& comp() { return lexer_.comp(); }
+    Comp& comp() { return comp_; }
+    /// Array mode: index of the next Tok.
+    size_t cursor() const { return cursor_; }
 
     /// @name misc
     //@{
     Ptr<Prg>    parse_prg();
+    /// Same as parse_prg but flattens each top-level Stmt right away and releases its tree via Comp::rewind.
+    FlatAST     parse_flat_prg();
+    Ptrs<Stmt>  parse_stmts(); ///< top-level Stmt%s up to Tok::Tag::M_eof
+    Ptr<Stmt>   parse_stmt();  ///< next top-level Stmt or @c nullptr at Tok::Tag::M_eof
     Ptr<Id>     parse_id(const char* ctxt = nullptr);
     Ptr<Expr>   parse_type_ascr(const char* ascr_ctxt = nullptr);
     Ptrs<Ptrn>  parse_doms();
@@ -73,9 +99,7 @@ public:
     //@{
     Ptr<Expr>      parse_expr(const char* ctxt = nullptr, Tok::Prec = Tok::Prec::Bottom);
     Ptr<Expr>      parse_prefix_expr();
-    Ptr<Expr>      parse_infix_expr(Tracker, Ptr<Expr>&&);
     Ptr<Expr>      parse_postfix_expr(Tracker, Ptr<Expr>&&);
-    Ptr<AppExpr>   parse_app_expr(Tracker, Ptr<Expr>&&);
     Ptr<FieldExpr> parse_field_expr(Tracker, Ptr<Expr>&&);
     //@}
 
@@ -94,7 +118,6 @@ public:
     Ptr<PiExpr>     parse_pi_expr();
     Ptr<PkExpr>     parse_pk_expr();
     Ptr<SigExpr>    parse_sig_expr();
-    Ptr<TupExpr>    parse_tup_expr(Tok::Tag delim_l = Tok::Tag::D_paren_l);
     Ptr<VarExpr>    parse_var_expr();
     Ptr<WhileExpr>  parse_while_expr();
     //@}
@@ -106,26 +129,79 @@ public:
     //@}
 
 private:
+    void init();
+    bool on_demand() const { return lexer_ || lexer_thread_; }
+    /// Skips the rest of the enclosing delimiters once they are nested deeper than Comp::max_depth.
+    Ptr<ErrExpr> skip_nested();
+    /**
+     * Panic mode: skips Tok%s up to the next @c ; - which is consumed - or up to the next @c }, @c let or nominal.
+     * Delimiters opened while skipping are skipped as a whole.
+     */
+    void recover();
+    /// Pretends the input ends right here; see Comp::max_errors.
+    void give_up();
+
     /// @name make AST nodes
     //@{
     Ptr<BlockExpr> mk_block_expr() { return mk_ptr<BlockExpr>  (prev_, Ptrs<Stmt>{}, mk_unit_tup()); }
     Ptr<ErrExpr>   mk_error_expr() { return mk_ptr<ErrExpr>    (prev_); }
-    Ptr<TupExpr>   mk_unit_tup()   { return mk_ptr<TupExpr>    (prev_, Ptrs<TupElem>{}, mk_unk_expr()); }
-    Ptr<UnkExpr>   mk_unk_expr()   { return mk_ptr<UnkExpr>(prev_); }
+    Ptr<TupExpr>   mk_unit_tup()   { return mk_leaf(comp().unit_tup(), prev_); }
+    Ptr<UnkExpr>   mk_unk_expr()   { return mk_leaf(comp().unk_expr(), prev_); }
 
     template<class T, class... Args>
-    Ptr<T> mk_ptr(Args&&... args) { return std::make_unique<const T>(comp(), std::forward<Args>(args)...); }
+    Ptr<T> mk_ptr(Args&&... args) {
+        const AST* children[] = {nullptr, leaf(args)...};
+        auto ptr = comp().mk<T>(std::forward<Args>(args)...);
+        if (!leaves_.empty()) set_leaf_locs(ptr, children);
+        return ptr;
+    }
+    template<class T, size_t N>
+    Ptrs<T> mk_ptrs(const PtrsBuilder<T, N>& builder) { return comp().mk_ptrs(builder); }
 
     Ptr<TupElem> mk_tup_elem(Ptr<Expr>&& expr) {
         auto loc = expr->loc;
         return mk_ptr<TupElem>(loc, mk_ptr<Id>(tok_id(loc)), std::move(expr));
     }
-    Ptr<Id> mk_id(const char* s)  { return mk_ptr<Id>(prev_, comp().sym(s)); }
+    Ptr<Id> mk_anonymous_id() { return mk_ptr<Id>(prev_, comp().anonymous()); }
     //@}
 
-    Tok tok_id(Loc loc, const char* s = "_") { return {loc, Tok::Tag::M_id, comp().sym(s)}; }
-    const Tok& ahead(size_t i = 0) const { assert(i < max_ahead); return ahead_[i]; }
-    Tok eat(Tok::Tag tag) { assert_unused(tag == ahead().tag() && "internal parser error"); return lex(); }
+    /// @name canonical leaves
+    /// The location of an occurrence is pending in @c leaves_ until its parent is made; see Comp::leaf_loc.
+    //@{
+    template<class T>
+    Ptr<T> mk_leaf(Ptr<T> leaf, Span loc) {
+        leaves_.emplace_back(leaf, loc);
+        return leaf;
+    }
+    template<class A>
+    const AST* leaf(const A& arg) {
+        if constexpr (std::is_convertible_v<A, const Expr*>) {
+            if (arg && comp().is_leaf(arg)) return arg;
+        }
+        return nullptr;
+    }
+    void set_leaf_locs(const AST* parent, std::span<const AST* const> children);
+    //@}
+
+    /// The Parser never interns itself: the Lexer may be doing so on another thread.
+    Tok tok_id(Span loc) { return {loc, Tok::Tag::M_id, comp().anonymous()}; }
+    Tok tok_err(Span loc) { return {loc, Tok::Tag::M_id, comp().error()}; }
+    Tok ahead(size_t i = 0) const {
+        assert(i < max_ahead);
+        if (on_demand()) return ahead_[i];
+        auto j = std::min(cursor_ + i, end_);
+        if (j == end_) return {{toks_->offset(j), toks_->offset(j)}, Tok::Tag::M_eof};
+        return (*toks_)[j];
+    }
+    Tok::Tag ahead_tag(size_t i = 0) const {
+        assert(i < max_ahead);
+        if (on_demand()) return ahead_[i].tag();
+        auto j = std::min(cursor_ + i, end_);
+        return j == end_ ? Tok::Tag::M_eof : toks_->tag(j);
+    }
+    /// In lazy mode, skips the block ahead by a balanced-brace scan; if @p operand, it must not continue as an operand.
+    std::optional<LazyExpr> skip_block(bool operand);
+    Tok eat(Tok::Tag tag) { assert_unused(tag == ahead_tag() && "internal parser error"); return lex(); }
     bool accept(Tok::Tag tok);
     bool expect(Tok::Tag tok, const char* ctxt);
     void err(const std::string& what, const char* ctxt) { err(what, ahead(), ctxt); }
@@ -133,13 +209,13 @@ private:
 
     template<class F>
     auto parse_list(Tok::Tag delim_r, F f, Tok::Tag sep = Tok::Tag::P_comma) {
-        std::deque<decltype(f())> result;
-        if (!ahead().isa(delim_r)) {
+        PtrsBuilder<std::remove_cv_t<std::remove_pointer_t<decltype(f())>>> result;
+        if (ahead_tag() != delim_r) {
             do {
                 result.emplace_back(f());
-            } while (accept(sep) && !ahead().isa(delim_r));
+            } while (accept(sep) && ahead_tag() != delim_r);
         }
-        return result;
+        return mk_ptrs(result);
     }
     template<class F>
     auto parse_list(const char* ctxt, Tok::Tag delim_l, Tok::Tag delim_r, F f, Tok::Tag sep = Tok::Tag::P_comma) {
@@ -149,22 +225,92 @@ private:
         return result;
     }
 
-    Tracker tracker() { return Tracker(*this, ahead().loc().begin); }
-    Tracker tracker(const Pos& pos) { return Tracker(*this, pos); }
+    Tracker tracker() { return Tracker(*this, on_demand() ? ahead_[0].loc().begin : toks_->offset(cursor_)); }
+    Tracker tracker(u32 begin) { return Tracker(*this, begin); }
 
     /// Consume next Tok in input stream, fill look-ahead buffer, return consumed Tok.
     Tok lex();
 
-    Lexer lexer_;                       ///< invoked in order to get next tok
-    static constexpr int max_ahead = 3; ///< maximum lookahead
-    std::array<Tok, max_ahead> ahead_;  ///< SLL look ahead
-    Loc prev_;
+    Comp& comp_;
+    std::optional<Lexer> lexer_;                ///< on-demand mode: invoked in order to get next tok
+    std::unique_ptr<LexerThread> lexer_thread_; ///< on-demand mode: alternatively lexes ahead on another thread
+    std::array<Tok, max_ahead> ahead_;          ///< on-demand mode: SLL look ahead
+    Toks own_toks_;                             ///< array mode: all toks of the input unless borrowed
+    const Toks* toks_ = &own_toks_;             ///< array mode: the toks to parse
+    size_t cursor_ = 0;                         ///< array mode: index of @c ahead()
+    size_t end_ = 0;                            ///< array mode: index of the (possibly implicit) M_eof
+    bool lazy_ = false;                         ///< array mode: skip bodies; @c toks_ live as long as the Comp
+    Span prev_;
+    std::vector<std::pair<const AST*, Span>> leaves_; ///< pending leaf occurrences; see mk_leaf
+    u32 err_begin_ = u32(-1); ///< of the Tok the last error has been reported at
+    int num_errors_ = 0;
+    bool given_up_ = false;
+
+    /// A prefix or infix operator that waits for its right operand in parse_expr.
+    struct Op {
+        u32 begin;       ///< of the whole Expr
+        Tok::Prec prec;  ///< to resume with once the Expr is complete
+        Ptr<Expr> lhs;   ///< @c nullptr for a prefix operator
+        Tok::Tag tag;
+    };
+    std::vector<Op> ops_; ///< pending operators and open tuples of all active parse_expr calls
+
+    /**
+     * @name tuples
+     * A tuple - or the argument of an AppExpr - is parsed within parse_expr: its Op has the opening delimiter as tag and
+     * the callee, if any, as lhs, and waits for the next element just like an operator waits for its right operand.
+     * The state of the element being parsed is kept in @c tups_ and the elements parsed so far in @c tup_elems_.
+     * Functions taking @p begin, @p p, and @p ctxt set them to go on parsing the next element or with the complete Expr.
+     */
+    //@{
+    struct Tup {
+        u32 begin;    ///< of the tuple
+        u32 elem;     ///< begin of the current element
+        size_t elems; ///< index of the first element in @c tup_elems_
+        Ptr<Id> id;   ///< of the current element
+    };
+    static bool is_tup(const Op& op) {
+        return op.tag == Tok::Tag::D_paren_l || op.tag == Tok::Tag::D_bracket_l || op.tag == Tok::Tag::D_not_bracket_l;
+    }
+    static Tok::Tag tup_delim_r(Tok::Tag delim_l) {
+        return delim_l == Tok::Tag::D_bracket_l ? Tok::Tag::D_bracket_r : Tok::Tag::D_paren_r;
+    }
+    /// Opens a tuple - the argument of @p callee unless @c nullptr; returns it like next_tup_elem if it is empty.
+    Ptr<Expr> open_tup(Ptr<Expr>&& callee, u32& begin, Tok::Prec& p, const char*& ctxt);
+    void start_tup_elem(u32& begin, Tok::Prec& p, const char*& ctxt);
+    /// Adds @p elem to the innermost tuple; returns the tuple - or its AppExpr - if it is closed and @c nullptr otherwise.
+    Ptr<Expr> next_tup_elem(Ptr<Expr>&& elem, u32& begin, Tok::Prec& p, const char*& ctxt);
+    Ptr<Expr> close_tup(u32& begin, Tok::Prec& p);
+
+    std::vector<Tup> tups_;
+    std::vector<Ptr<TupElem>> tup_elems_;
+    //@}
+
+    int depth_ = 0; ///< current nesting of primary Expr%s that are parsed recursively
 };
 
+/// @name parse
+/// The @c std::string_view overloads copy the text; pass a Source::borrow to parse it in place.
+//@{
 Ptr<Expr> parse_expr(Comp&, std::istream& is, const char* file);
-Ptr<Expr> parse_expr(Comp&, const char*);
+Ptr<Expr> parse_expr(Comp&, std::string_view, const char* file = "<inline>");
+Ptr<Expr> parse_expr(Comp&, Source&&);
 Ptr<Prg> parse(Comp&, std::istream& is, const char* file);
-Ptr<Prg> parse(Comp&, const char*);
+Ptr<Prg> parse(Comp&, std::string_view, const char* file = "<inline>");
+Ptr<Prg> parse(Comp&, Source&&);
+//@}
+/**
+ * Parses the top-level Stmt%s of @p toks on several threads.
+ * A pre-pass cuts @p toks into chunks of at least @p chunk_size Tok%s right before a top-level @c let or nominal
+ * statement, i.e., after a @c } or @c ; outside of any delimiters.
+ * If any chunk yields diagnostics, @p toks are parsed again serially: diagnostics never depend on the chunking.
+ * @p num_chunks - if given - receives the number of chunks the result was parsed from, i.e., 1 if parsed serially.
+ */
+Ptr<Prg> parse_parallel(Comp&, Toks&& toks, size_t chunk_size = 1 << 14, size_t* num_chunks = nullptr);
+/// Memory-maps @p file and parses it.
+Ptr<Prg> parse_file(Comp&, const char* file);
+/// Same as above but yields a FlatAST; see Parser::parse_flat_prg.
+FlatAST parse_flat_file(Comp&, const char* file);
 
 }
 
@@ -0,0 +1,60 @@
+#ifndef DIMPL_RING_H
+#define DIMPL_RING_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <thread>
+
+namespace dimpl {
+
+/**
+ * Bounded, lock-free ring buffer for exactly one producer and one consumer thread.
+ * Each side caches the other side's index and only reloads it when the ring looks full or empty, respectively.
+ */
+template<class T, size_t N>
+class Ring {
+    static_assert(std::has_single_bit(N), "N must be a power of two");
+
+public:
+    /// Producer only. Waits while the ring is full; yields @c false without pushing if the ring has been closed.
+    bool push(T&& t) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        while (tail - head_cache_ == N) {
+            if (closed_.load(std::memory_order_relaxed)) return false;
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ == N) std::this_thread::yield();
+        }
+        slots_[tail & (N - 1)] = std::move(t);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer only. Waits while the ring is empty.
+    T pop() {
+        auto head = head_.load(std::memory_order_relaxed);
+        while (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) std::this_thread::yield();
+        }
+        T t = std::move(slots_[head & (N - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        return t;
+    }
+
+    /// Consumer only. Makes a waiting or future push give up.
+    void close() { closed_.store(true, std::memory_order_relaxed); }
+
+private:
+    std::array<T, N> slots_;
+    alignas(64) std::atomic<size_t> head_ = 0; ///< next slot to pop
+    size_t tail_cache_ = 0;                    ///< consumer's copy of @c tail_
+    alignas(64) std::atomic<size_t> tail_ = 0; ///< next slot to push
+    size_t head_cache_ = 0;                    ///< producer's copy of @c head_
+    alignas(64) std::atomic<bool> closed_ = false;
+};
+
+}
+
+#endif
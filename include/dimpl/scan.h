@@ -0,0 +1,167 @@
+#ifndef DIMPL_SCAN_H
+#define DIMPL_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @file
+ * Bulk scanning of byte runs for the Lexer.
+ * Each function scans <tt>[p, end)</tt> and returns a pointer to the first byte that does (not) belong to the run.
+ * Uses AVX2 if compiled with @c -mavx2 (or @c -march=native), SSE2 on any x86-64, and a scalar loop otherwise and for
+ * the tail.
+ */
+
+namespace dimpl::scan {
+
+namespace detail {
+
+#if defined(__AVX2__)
+using Vec = __m256i;
+using Mask = uint32_t;
+constexpr ptrdiff_t Width = 32;
+inline Vec  load(const char* p)  { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Vec  splat(char c)        { return _mm256_set1_epi8(c); }
+inline Vec  eq (Vec a, Vec b)    { return _mm256_cmpeq_epi8(a, b); }
+inline Vec  ule(Vec a, Vec b)    { return _mm256_cmpeq_epi8(_mm256_min_epu8(a, b), a); } ///< unsigned <tt>a <= b</tt>
+inline Vec  sub(Vec a, Vec b)    { return _mm256_sub_epi8(a, b); }
+inline Vec  bor(Vec a, Vec b)    { return _mm256_or_si256(a, b); }
+inline Mask mask(Vec v)          { return Mask(_mm256_movemask_epi8(v)); }
+#define DIMPL_SIMD 1
+#elif defined(__SSE2__)
+using Vec = __m128i;
+using Mask = uint32_t;
+constexpr ptrdiff_t Width = 16;
+inline Vec  load(const char* p)  { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Vec  splat(char c)        { return _mm_set1_epi8(c); }
+inline Vec  eq (Vec a, Vec b)    { return _mm_cmpeq_epi8(a, b); }
+inline Vec  ule(Vec a, Vec b)    { return _mm_cmpeq_epi8(_mm_min_epu8(a, b), a); } ///< unsigned <tt>a <= b</tt>
+inline Vec  sub(Vec a, Vec b)    { return _mm_sub_epi8(a, b); }
+inline Vec  bor(Vec a, Vec b)    { return _mm_or_si128(a, b); }
+inline Mask mask(Vec v)          { return Mask(_mm_movemask_epi8(v)); }
+#define DIMPL_SIMD 1
+#else
+#define DIMPL_SIMD 0
+#endif
+
+#if DIMPL_SIMD
+constexpr Mask Full = Width == 32 ? Mask(0xffffffff) : Mask(0xffff);
+
+/// Skips bytes for which @p vpred yields a set lane and @p spred yields @c true; @p until inverts the predicates.
+template<bool until, class V, class S>
+const char* skip(const char* p, const char* end, V vpred, S spred) {
+    for (; end - p >= Width; p += Width) {
+        auto m = mask(vpred(load(p)));
+        if (!until) m = ~m & Full;
+        if (m != 0) return p + __builtin_ctz(m);
+    }
+    while (p != end && spred((unsigned char) *p) != until) ++p;
+    return p;
+}
+#else
+template<bool until, class V, class S>
+const char* skip(const char* p, const char* end, V, S spred) {
+    while (p != end && spred((unsigned char) *p) != until) ++p;
+    return p;
+}
+#endif
+
+}
+
+/// Skips @c ' ', @c '\\t', @c '\\n', @c '\\v', @c '\\f' and @c '\\r'.
+inline const char* skip_wsp(const char* p, const char* end) {
+    using namespace detail;
+    return skip<false>(p, end,
+#if DIMPL_SIMD
+        [](Vec v) { return bor(eq(v, splat(' ')), ule(sub(v, splat('\t')), splat('\r' - '\t'))); },
+#else
+        nullptr,
+#endif
+        [](unsigned char c) { return c == ' ' || ('\t' <= c && c <= '\r'); });
+}
+
+/// Skips <tt>[0-9]</tt>.
+inline const char* skip_dec(const char* p, const char* end) {
+    using namespace detail;
+    return skip<false>(p, end,
+#if DIMPL_SIMD
+        [](Vec v) { return ule(sub(v, splat('0')), splat(9)); },
+#else
+        nullptr,
+#endif
+        [](unsigned char c) { return '0' <= c && c <= '9'; });
+}
+
+/// Skips <tt>[a-zA-Z0-9_]</tt>.
+inline const char* skip_id(const char* p, const char* end) {
+    using namespace detail;
+    return skip<false>(p, end,
+#if DIMPL_SIMD
+        [](Vec v) {
+            auto alpha = ule(sub(bor(v, splat(0x20)), splat('a')), splat('z' - 'a'));
+            auto digit = ule(sub(v, splat('0')), splat(9));
+            return bor(bor(alpha, digit), eq(v, splat('_')));
+        },
+#else
+        nullptr,
+#endif
+        [](unsigned char c) {
+            return ('a' <= (c | 0x20) && (c | 0x20) <= 'z') || ('0' <= c && c <= '9') || c == '_';
+        });
+}
+
+/// Finds the first occurrence of @p c or returns @p end.
+inline const char* find(const char* p, const char* end, char c) {
+    using namespace detail;
+    return skip<true>(p, end,
+#if DIMPL_SIMD
+        [c](Vec v) { return eq(v, splat(c)); },
+#else
+        nullptr,
+#endif
+        [c](unsigned char b) { return b == (unsigned char) c; });
+}
+
+/**
+ * Validates UTF-8 as specified in Table 3-7 of the Unicode Standard (no overlongs, surrogates or code points beyond
+ * U+10FFFF) and returns a pointer to the first malformed sequence or @p end.
+ * Blocks of pure ASCII are skipped a vector at a time.
+ */
+inline const char* validate_utf8(const char* p, const char* end) {
+    using namespace detail;
+    auto cont = [&](ptrdiff_t i, unsigned char lo = 0x80, unsigned char hi = 0xbf) {
+        if (end - p <= i) return false;
+        auto b = (unsigned char) p[i];
+        return lo <= b && b <= hi;
+    };
+
+    while (true) {
+#if DIMPL_SIMD
+        while (end - p >= Width && mask(load(p)) == 0) p += Width;
+#endif
+        if (p == end) return end;
+
+        auto b = (unsigned char) *p;
+        ptrdiff_t n = 0;
+        if      (b < 0x80)                                                                    n = 1;
+        else if (0xc2 <= b && b <= 0xdf && cont(1))                                           n = 2;
+        else if (b == 0xe0 && cont(1, 0xa0) && cont(2))                                       n = 3;
+        else if (((0xe1 <= b && b <= 0xec) || b == 0xee || b == 0xef) && cont(1) && cont(2))  n = 3;
+        else if (b == 0xed && cont(1, 0x80, 0x9f) && cont(2))                                 n = 3;
+        else if (b == 0xf0 && cont(1, 0x90) && cont(2) && cont(3))                            n = 4;
+        else if (0xf1 <= b && b <= 0xf3 && cont(1) && cont(2) && cont(3))                     n = 4;
+        else if (b == 0xf4 && cont(1, 0x80, 0x8f) && cont(2) && cont(3))                      n = 4;
+        else return p;
+        p += n;
+    }
+}
+
+}
+
+#undef DIMPL_SIMD
+
+#endif
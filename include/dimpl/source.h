@@ -0,0 +1,122 @@
+#ifndef DIMPL_SOURCE_H
+#define DIMPL_SOURCE_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <thorin/debug.h>
+
+namespace dimpl {
+
+/// A read-only, contiguous source buffer.
+/// Files are memory-mapped; in-memory sources own their text unless explicitly borrowed.
+class Source {
+public:
+    Source(const Source&) = delete;
+    Source& operator=(const Source&) = delete;
+    Source(Source&&);
+    Source& operator=(Source&&);
+
+    /// Maps @p filename into memory.
+    explicit Source(const char* filename);
+    /**
+     * References @p text without copying it.
+     * A Source handed to a SourceManager lives as long as the Comp: @p text must outlive the Comp.
+     */
+    static Source borrow(std::string_view text, const char* filename) { return Source(text, filename); }
+    /// Owns @p text.
+    Source(std::string&& text, const char* filename)
+        : filename_(filename)
+        , owned_(std::move(text))
+        , text_(owned_)
+    {}
+    ~Source();
+
+    const char* filename() const { return filename_; }
+    std::string_view text() const { return text_; }
+
+private:
+    Source(std::string_view text, const char* filename)
+        : filename_(filename)
+        , text_(text)
+    {}
+
+    void unmap();
+
+    const char* filename_;
+    std::string owned_;
+    std::string_view text_;
+    void* map_ = nullptr;
+    size_t map_size_ = 0;
+};
+
+/// Compact location: the half-open byte range <tt>[begin, finis)</tt> in the offset space of a SourceManager.
+struct Span {
+    Span() {}
+    Span(uint32_t begin, uint32_t finis)
+        : begin(begin)
+        , finis(finis)
+    {}
+
+    bool operator==(Span other) const { return begin == other.begin && finis == other.finis; }
+
+    uint32_t begin = 0;
+    uint32_t finis = 0;
+};
+
+/**
+ * Owns all Source%s of a compilation and lays them out one after another in a single 32-bit offset space.
+ * Span%s are only decoded to file/row/col on demand; the newline index of a Source is built on first use.
+ */
+class SourceManager {
+public:
+    struct File {
+        /// How a superseded File turns into its next version; see SourceManager::edit.
+        struct Edit {
+            const File* next = nullptr;
+            uint32_t offset   = 0; ///< relative to this File
+            uint32_t removed  = 0; ///< number of bytes
+            uint32_t inserted = 0; ///< number of bytes
+        };
+
+        Source src;
+        uint32_t base; ///< offset of the first byte of @p src
+        mutable std::vector<uint32_t> lines = {}; ///< relative offsets of all line begins; built on demand
+        Edit edit = {};
+    };
+
+    /// Takes ownership of @p src.
+    const File& add(Source&& src);
+    /**
+     * Adds @p src as the next version of @p prev: @p src is @p prev with @p removed bytes at @p offset replaced by
+     * @p inserted bytes.
+     * The text of @p prev is released; Span%s into @p prev are decoded in the latest version from then on.
+     * Each version takes up its own range in the offset space; see SourceManager::rebase.
+     */
+    const File& edit(const File& prev, Source&& src, uint32_t offset, uint32_t removed, uint32_t inserted);
+    /**
+     * Releases @p first and all its later versions and adds @p src in their place - if nothing else has been added
+     * since @p first; otherwise, @p src is just added.
+     * No Span into a released version may be decoded anymore.
+     */
+    const File& rebase(const File& first, Source&& src);
+    /// The File @p offset belongs to; one past the end of a File still belongs to it.
+    const File& file(uint32_t offset) const;
+    thorin::Loc loc(Span) const;
+
+private:
+    thorin::Loc loc(const File&, Span) const;
+    thorin::Pos pos(const File&, uint32_t offset) const;
+
+    std::deque<File> files_;
+    uint32_t end_ = 0;
+    mutable std::mutex lines_mutex_; ///< a LexerThread may report diagnostics concurrently to the Parser
+};
+
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef DIMPL_STREAMING_H
+#define DIMPL_STREAMING_H
+
+#include <functional>
+
+#include "dimpl/ast.h"
+#include "dimpl/bind.h"
+
+namespace dimpl {
+
+class Parser;
+
+/**
+ * Parses and binds the input of @p parser one item at a time, so peak memory is bounded by the largest item instead
+ * of the whole input.
+ * An item is a run of adjacent NomStmt%s - which may refer to each other as in Scopes::bind_stmts - up to and
+ * including the next other Stmt.
+ * Each item is bound in a new outermost scope of @p scopes and handed to @p f, e.g. for emission.
+ * Then its AST is released via Comp::rewind; its top-level Decl%s stay visible to later items as stubs - see
+ * Scopes::stub_decls.
+ * No other thread may make AST nodes meanwhile.
+ * @returns the number of items.
+ */
+size_t for_each_item(Parser& parser, Scopes& scopes, const std::function<void(const Ptrs<Stmt>&)>& f);
+/// Same as above but lexes @p file on demand - on another thread with Comp::pipeline.
+size_t for_each_item(Comp&, const char* file, Scopes& scopes, const std::function<void(const Ptrs<Stmt>&)>& f);
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef DIMPL_SYM_H
+#define DIMPL_SYM_H
+
+#include <array>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <thorin/util/hash.h>
+#include <thorin/util/stream.h>
+#include <thorin/util/types.h>
+
+#include "dimpl/arena.h"
+
+namespace dimpl {
+
+using namespace thorin::types;
+
+class SymTable;
+
+/// An interned string; two Sym%s are equal iff their strings are equal.
+class Sym : public thorin::Streamable<Sym> {
+private:
+    /// Lives in the SymTable's Arena and is immediately followed by the string's bytes.
+    struct Entry {
+        u32 id;
+        u32 size;
+        u32 hash;
+    };
+
+    explicit Sym(const Entry* entry)
+        : entry_(entry)
+    {}
+
+public:
+    Sym() {}
+
+    /// 32-bit id, unique within its SymTable; see SymTable::sym(u32).
+    u32 id() const { return entry_->id; }
+    std::string_view str() const { return {reinterpret_cast<const char*>(entry_ + 1), entry_->size}; }
+    bool operator==(Sym other) const { return this->entry_ == other.entry_; }
+    thorin::Stream& stream(thorin::Stream& s) const { return s << str(); }
+
+private:
+    const Entry* entry_ = nullptr;
+
+    friend class SymTable;
+    friend struct SymHash;
+};
+
+struct SymHash {
+    static thorin::hash_t hash(Sym sym) { return thorin::murmur3(sym.id()); }
+    static bool eq(Sym a, Sym b) { return a == b; }
+    static Sym sentinel() { return Sym((const Sym::Entry*) 1); }
+};
+
+template<class Val>
+using SymMap = thorin::HashMap<Sym, Val, SymHash>;
+using SymSet = thorin::HashSet<Sym, SymHash>;
+
+/**
+ * Interns strings: each distinct string is copied once into an Arena and looked up by @c std::string_view.
+ * The table is split into shards by hash, each with its own lock, so Lexer%s on several threads can intern at once.
+ */
+class SymTable {
+public:
+    static constexpr u32 Shard_Bits = 4;
+    static constexpr u32 Num_Shards = 1 << Shard_Bits;
+
+    SymTable(const SymTable&) = delete;
+    SymTable& operator=(SymTable) = delete;
+    SymTable() {}
+
+    Sym sym(std::string_view);
+    /// Inverse of Sym::id; must not run concurrently to interning.
+    Sym sym(u32 id) const { return Sym(shards_[id & (Num_Shards - 1)].syms[id >> Shard_Bits]); }
+    size_t size() const;
+
+private:
+    struct Shard {
+        Shard();
+        void rehash();
+
+        std::mutex mutex;
+        Arena arena;
+        std::vector<const Sym::Entry*> syms;  ///< by id
+        std::vector<const Sym::Entry*> table; ///< open addressing with linear probing; size is a power of two
+    };
+
+    std::array<Shard, Num_Shards> shards_;
+};
+
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef DIMPL_VISIT_H
+#define DIMPL_VISIT_H
+
+#include <type_traits>
+
+#include "dimpl/ast.h"
+
+namespace dimpl {
+
+namespace detail {
+
+/// Concrete node types - in contrast to abstract bases like Stmt - carry a static @c Node.
+template<class T> concept concrete_node = requires { T::Node; };
+
+}
+
+/**
+ * Calls @p f with @p ast downcast to its dynamic node type.
+ * Dispatches with a @c switch over AST::node instead of a virtual call: @p f's overload for each node is known
+ * statically and may be inlined.
+ * Only the concrete node types derived from @p B - those with a static @c Node - are instantiated: visiting a
+ * <tt>const Expr*</tt> merely needs @p f to accept every kind of Expr.
+ * Passes written against this need no virtual method in ast.h; see Walker.
+ *
+ * All overloads that the compiler inlines end up in one function.
+ * A recursive pass then pays for the stack frame of the largest one at every level; prefer a Walker or keep larger
+ * overloads out of line.
+ * @p f is taken by value: a lambda capturing @c this is passed in a register.
+ */
+template<class R = void, class B, class F>
+R visit(const B* ast, F f) {
+    switch (ast->node()) {
+#define CODE(node)                                                                        \
+        case Node::node:                                                                  \
+            if constexpr (std::is_base_of_v<B, node> && detail::concrete_node<node>)      \
+                return f(static_cast<const node*>(ast));                                  \
+            else                                                                          \
+                THORIN_UNREACHABLE;
+        DIMPL_NODE(CODE)
+#undef CODE
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+}
+
+#endif
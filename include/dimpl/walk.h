@@ -0,0 +1,162 @@
+#ifndef DIMPL_WALK_H
+#define DIMPL_WALK_H
+
+#include <vector>
+
+#include "dimpl/visit.h"
+
+namespace dimpl {
+
+namespace detail {
+
+inline const AST* nth(size_t) { return nullptr; }
+
+/// The @p i-th element of @p ast and @p rest - single nodes and Ptrs - in a row; @c nullptr past the end.
+template<class T, class... Rest>
+const AST* nth(size_t i, const T* ast, const Rest&... rest) {
+    return i == 0 ? ast : nth(i - 1, rest...);
+}
+
+template<class T, class... Rest>
+const AST* nth(size_t i, const Ptrs<T>& ptrs, const Rest&... rest) {
+    return i < ptrs.size() ? ptrs[i] : nth(i - ptrs.size(), rest...);
+}
+
+}
+
+/// @name child
+/// The @p i-th child of a node in source order or @c nullptr past the last one; Id%s are not considered children.
+//@{
+inline const AST* child(const Prg*         ast, size_t i) { return detail::nth(i, ast->stmts); }
+inline const AST* child(const Id*             , size_t  ) { return nullptr; }
+inline const AST* child(const NomNom*      ast, size_t i) { return detail::nth(i, ast->type, ast->body()); }
+inline const AST* child(const AbsNom*      ast, size_t i) { return detail::nth(i, ast->doms, ast->codom, ast->body()); }
+inline const AST* child(const SigNom*         , size_t  ) { return nullptr; }
+inline const AST* child(const ErrBndr*        , size_t  ) { return nullptr; }
+inline const AST* child(const IdBndr*      ast, size_t i) { return detail::nth(i, ast->type); }
+inline const AST* child(const SigBndr*     ast, size_t i) { return detail::nth(i, ast->elems); }
+inline const AST* child(const ErrPtrn*        , size_t  ) { return nullptr; }
+inline const AST* child(const IdPtrn*      ast, size_t i) { return detail::nth(i, ast->type); }
+inline const AST* child(const TupPtrn*     ast, size_t i) { return detail::nth(i, ast->elems); }
+inline const AST* child(const AssignStmt*  ast, size_t i) { return detail::nth(i, ast->lhs, ast->rhs); }
+inline const AST* child(const ExprStmt*    ast, size_t i) { return detail::nth(i, ast->expr); }
+inline const AST* child(const LetStmt*     ast, size_t i) { return detail::nth(i, ast->ptrn, ast->init); }
+inline const AST* child(const NomStmt*     ast, size_t i) { return detail::nth(i, ast->nom); }
+inline const AST* child(const AbsExpr*     ast, size_t i) { return detail::nth(i, ast->abs); }
+inline const AST* child(const TupElem*     ast, size_t i) { return detail::nth(i, ast->expr); }
+inline const AST* child(const TupExpr*     ast, size_t i) { return detail::nth(i, ast->elems, ast->type); }
+inline const AST* child(const AppExpr*     ast, size_t i) { return detail::nth(i, ast->callee, ast->arg); }
+inline const AST* child(const BlockExpr*   ast, size_t i) { return detail::nth(i, ast->stmts, ast->expr); }
+inline const AST* child(const BottomExpr*     , size_t  ) { return nullptr; }
+inline const AST* child(const ErrExpr*        , size_t  ) { return nullptr; }
+inline const AST* child(const FieldExpr*   ast, size_t i) { return detail::nth(i, ast->lhs); }
+inline const AST* child(const ForExpr*     ast, size_t i) { return detail::nth(i, ast->ptrn, ast->expr, ast->body); }
+inline const AST* child(const IdExpr*         , size_t  ) { return nullptr; }
+inline const AST* child(const IfExpr*      ast, size_t i) { return detail::nth(i, ast->cond, ast->then_expr, ast->else_expr); }
+inline const AST* child(const InfixExpr*   ast, size_t i) { return detail::nth(i, ast->lhs, ast->rhs); }
+inline const AST* child(const LitExpr*        , size_t  ) { return nullptr; }
+inline const AST* child(const MatchExpr*      , size_t  ) { return nullptr; }
+inline const AST* child(const PkExpr*      ast, size_t i) { return detail::nth(i, ast->dims, ast->body); }
+inline const AST* child(const PiExpr*      ast, size_t i) { return detail::nth(i, ast->doms, ast->codom); }
+inline const AST* child(const PrefixExpr*  ast, size_t i) { return detail::nth(i, ast->rhs); }
+inline const AST* child(const PostfixExpr* ast, size_t i) { return detail::nth(i, ast->lhs); }
+inline const AST* child(const KeyExpr*        , size_t  ) { return nullptr; }
+inline const AST* child(const ArExpr*      ast, size_t i) { return detail::nth(i, ast->dims, ast->body); }
+inline const AST* child(const SigExpr*     ast, size_t i) { return detail::nth(i, ast->elems); }
+inline const AST* child(const UnkExpr*        , size_t  ) { return nullptr; }
+inline const AST* child(const VarExpr*        , size_t  ) { return nullptr; }
+inline const AST* child(const WhileExpr*   ast, size_t i) { return detail::nth(i, ast->cond, ast->body); }
+//@}
+
+/**
+ * Walks the AST with an explicit stack instead of recursion: arbitrarily deep trees - e.g. a sum of a million terms
+ * - neither overflow the native stack nor pay for a call per level.
+ * The pass @p P derives from Walker and may hide any of these hooks for a node type @c T:
+ * * <tt>bool enter(const T*)</tt> runs in pre-order; @c false skips the node's children and its @c exit.
+ * * <tt>const AST* child(const T*, size_t i)</tt> yields the @p i-th child to walk and @c nullptr once the node is
+ *   done; it runs before each child and may act in between two of them - or reorder and skip children.
+ *   Defaults to dimpl::child.
+ * * <tt>void exit(const T*)</tt> runs in post-order.
+ *
+ * A pass that provides some overloads of a hook pulls in the defaults with a using-declaration; Walker::loc locates
+ * the node of the running hook.
+ * Hooks are dispatched via visit and may start a nested walk.
+ */
+template<class P>
+class Walker {
+public:
+    void walk(const AST* ast) {
+        auto base = stack_.size();
+        push(ast, ast->loc);
+        while (stack_.size() != base) {
+            auto ast = stack_.back().ast;
+            auto i   = stack_.back().i++;
+            loc_     = stack_.back().loc;
+            if (auto child = visit<const AST*>(ast, [this, i](auto ast) { return self().child(ast, i); })) {
+                push(child, ast->comp.is_leaf(child) ? leaf_loc(stack_.back(), child) : child->loc);
+            } else {
+                stack_.pop_back();
+                visit(ast, [this](auto ast) { self().exit(ast); });
+            }
+        }
+    }
+
+    /// @name default hooks
+    //@{
+    template<class T> bool enter(const T*) { return true; }
+    template<class T> const AST* child(const T* ast, size_t i) { return dimpl::child(ast, i); }
+    template<class T> void exit(const T*) {}
+    //@}
+
+protected:
+    /// Location of the node whose hook runs - for a canonical leaf the one of its occurrence; see Comp::leaf_loc.
+    /// A nested walk started from the hook changes it.
+    Span loc() const { return loc_; }
+
+private:
+    P& self() { return *static_cast<P*>(this); }
+
+    void push(const AST* ast, Span loc) {
+        loc_ = loc;
+        if (visit<bool>(ast, [this](auto ast) { return self().enter(ast); })) stack_.emplace_back(ast, loc);
+    }
+
+    struct Frame {
+        Frame(const AST* ast, Span loc)
+            : ast(ast)
+            , loc(loc)
+        {}
+
+        const AST* ast;
+        Span loc;
+        size_t i = 0;          ///< next child
+        size_t pos = 0;        ///< next child in the order of dimpl::child
+        size_t num_leaves = 0; ///< canonical leaves before @c pos
+    };
+
+    /// Finds @p leaf among the children of @p parent in constructor argument order - the order of dimpl::child - even if
+    /// the @c child hook skips or reorders them.
+    static Span leaf_loc(Frame& parent, const AST* leaf) {
+        auto& comp = parent.ast->comp;
+        if (!comp.has_leaf_locs(parent.ast)) return parent.loc; // e.g. the unknown of a unit tuple
+
+        auto nth = [&](size_t i) { return visit<const AST*>(parent.ast, [i](auto ast) { return dimpl::child(ast, i); }); };
+        for (int pass = 0; pass != 2; ++pass, parent.pos = parent.num_leaves = 0) {
+            for (const AST* child; (child = nth(parent.pos)) != nullptr; ++parent.pos) {
+                if (child == leaf) {
+                    ++parent.pos;
+                    return comp.leaf_loc(parent.ast, parent.num_leaves++);
+                }
+                if (comp.is_leaf(child)) ++parent.num_leaves;
+            }
+        }
+        return parent.loc;
+    }
+
+    Span loc_;
+    std::vector<Frame> stack_;
+};
+
+}
+
+#endif
@@ -1,9 +1,57 @@
 #include "dimpl/bind.h"
 
 #include "dimpl/ast.h"
+#include "dimpl/walk.h"
 
 namespace dimpl {
 
+namespace {
+
+/// Binds the nodes of the AST in one walk; see Walker.
+class Binder : public Walker<Binder> {
+public:
+    Binder(Scopes& s)
+        : s(s)
+    {}
+
+    using Walker::enter;
+    using Walker::child;
+    using Walker::exit;
+
+    /// Inserts the run of NomStmt%s starting at @p stmts[i] - if any - up front, so they may refer to each other.
+    void insert_noms(const Ptrs<Stmt>& stmts, size_t i);
+    /// Each dimension of a PkExpr or ArExpr gets its own scope.
+    template<class T> const AST* dim(const T*, size_t i);
+
+    bool enter(const Prg*      ) { s.push(); return true; }
+    bool enter(const AbsNom*   );
+    bool enter(const BlockExpr*) { s.push(); return true; }
+    bool enter(const IdExpr*   );
+    bool enter(const PiExpr*   ) { s.push(); return true; }
+    bool enter(const SigExpr*  ) { s.push(); return true; }
+    bool enter(const VarExpr*  );
+
+    const AST* child(const Prg*,       size_t);
+    const AST* child(const BlockExpr*, size_t);
+    const AST* child(const ArExpr* e,  size_t i) { return dim(e, i); }
+    const AST* child(const PkExpr* e,  size_t i) { return dim(e, i); }
+    const AST* child(const ForExpr*,   size_t);
+    const AST* child(const LetStmt*,   size_t);
+
+    void exit(const Prg*      ) { s.pop(); }
+    void exit(const AbsNom*   ) { s.pop(); }
+    void exit(const BlockExpr*) { s.pop(); }
+    void exit(const PiExpr*   ) { s.pop(); }
+    void exit(const SigExpr*  ) { s.pop(); }
+    void exit(const IdBndr*   );
+    void exit(const IdPtrn*   );
+
+private:
+    Scopes& s;
+};
+
+}
+
 /*
  * Scopes
  */
@@ -25,24 +73,24 @@ void Scopes::insert(const Decl* decl) {
         if (i->second) {
             comp().err(decl->id->loc, "redefinition of '{}'", sym);
             comp().note(i->second->id->loc, "previous declaration of '{}' was here", sym);
+            return;
         } else {
             i->second = decl; // now we have a valid definition
         }
     }
+    if (scopes_.size() == 1) outermost_.emplace_back(decl);
 }
 
-void Scopes::bind_stmts(const Ptrs<Stmt>& stmts) {
-    for (auto i = stmts.begin(), e = stmts.end(); i != e;) {
-        if (isa<NomStmt>(*i)) {
-            for (auto j = i; j != e && isa<NomStmt>(*j); ++j)
-                insert(as<NomStmt>(*j)->nom.get());
-            for (; i != e && isa<NomStmt>(*i); ++i)
-                as<NomStmt>(*i)->nom->bind(*this);
-        } else {
-            (*i)->bind(*this);
-            ++i;
-        }
+void Scopes::stub_decls() {
+    assert(scopes_.size() == 1);
+
+    for (auto decl : outermost_) {
+        auto id   = new (stubs_.alloc(sizeof(Id),   alignof(Id)))   Id(comp(), decl->id->loc, decl->sym());
+        auto stub = new (stubs_.alloc(sizeof(Decl), alignof(Decl))) Decl(id, Ptr<Id>(id));
+        stub->def = decl->def;
+        scopes_.front()[decl->sym()] = stub;
     }
+    outermost_.clear();
 }
 
 void Scopes::use(const Use* use) {
@@ -60,177 +108,70 @@ void Scopes::use(const Use* use) {
     }
 }
 
-//------------------------------------------------------------------------------
-
-/*
- * misc
- */
-
-void Prg::bind(Scopes& s) const {
-    s.push();
-    s.bind_stmts(stmts);
-    s.pop();
-}
-
-/*
-void Bndr::infiltrate(Scopes& s) const {
-    if (auto sigma = isa<SigExpr>(type))
-        sigma->bind_unscoped(s);
-    else
-        type->bind(s);
-
-    s.insert(this);
-}
-*/
-
-/*
- * Nom
- */
-
-void NomNom::bind(Scopes& s) const {
-    type->bind(s);
-    body->bind(s);
-}
+void Scopes::bind(const Prg* prg) { Binder(*this).walk(prg); }
 
-void AbsNom::bind(Scopes& s) const {
-    s.push();
-    s.insert(this);
-    for (auto&& dom : doms) dom->bind(s);
-    codom->bind(s);
-    body->bind(s);
-    s.pop();
-}
-
-/*
- * Bndr
- */
-
-void Bndr::bind(Scopes& s) const {
-    s.push();
-    infiltrate(s);
-    s.pop();
-}
-
-void ErrBndr::infiltrate(Scopes&) const {}
-
-void IdBndr::infiltrate(Scopes& s) const {
-    type->bind(s);
-    s.insert(this);
+void Scopes::bind_stmts(const Ptrs<Stmt>& stmts) {
+    Binder binder(*this);
+    for (size_t i = 0, e = stmts.size(); i != e; ++i) {
+        binder.insert_noms(stmts, i);
+        binder.walk(stmts[i]);
+    }
 }
 
-void SigBndr::infiltrate(Scopes& s) const {
-    for (auto&& elem : elems) elem->infiltrate(s);
-}
+//------------------------------------------------------------------------------
 
 /*
- * Ptrn
+ * Binder
  */
 
-void ErrPtrn::bind(Scopes&) const {}
-
-void IdPtrn::bind(Scopes& s) const {
-    type->bind(s);
-    s.insert(this);
+void Binder::insert_noms(const Ptrs<Stmt>& stmts, size_t i) {
+    if (i >= stmts.size() || !isa<NomStmt>(stmts[i]) || (i != 0 && isa<NomStmt>(stmts[i - 1]))) return;
+    for (; i != stmts.size() && isa<NomStmt>(stmts[i]); ++i)
+        s.insert(as<NomStmt>(stmts[i])->nom);
 }
 
-void TupPtrn::bind(Scopes& s) const {
-    for (auto&& elem : elems) elem->bind(s);
+template<class T>
+const AST* Binder::dim(const T* ast, size_t i) {
+    auto n = ast->dims.size();
+    if (i != 0 && i <= n) s.pop();
+    if (i < n) s.push();
+    return dimpl::child(ast, i);
 }
 
-/*
- * Expr
- */
-
-void BottomExpr ::bind(Scopes&  ) const {}
-void ErrExpr    ::bind(Scopes&  ) const {}
-void KeyExpr    ::bind(Scopes&  ) const {}
-void LitExpr    ::bind(Scopes&  ) const {}
-void UnkExpr    ::bind(Scopes&  ) const {}
-void IdExpr     ::bind(Scopes& s) const { s.use(this); }
-void VarExpr    ::bind(Scopes& s) const { s.use(this); }
-void AbsExpr    ::bind(Scopes& s) const { abs->bind(s); }
-void FieldExpr  ::bind(Scopes& s) const { lhs->bind(s); }
-void PostfixExpr::bind(Scopes& s) const { lhs->bind(s); }
-void PrefixExpr ::bind(Scopes& s) const { rhs->bind(s); }
-void TupElem    ::bind(Scopes& s) const { expr->bind(s); }
-
-void AppExpr::bind(Scopes& s) const {
-    callee->bind(s);
-    arg->bind(s);
-}
-
-void BlockExpr::bind(Scopes& s) const {
+bool Binder::enter(const AbsNom* abs) {
     s.push();
-    s.bind_stmts(stmts);
-    expr->bind(s);
-    s.pop();
+    s.insert(abs);
+    return true;
 }
 
-void PiExpr::bind(Scopes& s) const {
-    s.push();
-    for (auto&& dom : doms) dom->infiltrate(s);
-    codom->bind(s);
-    s.pop();
+bool Binder::enter(const IdExpr* e) {
+    s.use(e);
+    return true;
 }
 
-void ForExpr::bind(Scopes& s) const {
-    ptrn->bind(s);
-    body->bind(s);
+bool Binder::enter(const VarExpr* e) {
+    s.use(e);
+    return true;
 }
 
-void IfExpr::bind(Scopes& s) const {
-    cond->bind(s);
-    then_expr->bind(s);
-    else_expr->bind(s);
+const AST* Binder::child(const Prg* prg, size_t i) {
+    insert_noms(prg->stmts, i);
+    return dimpl::child(prg, i);
 }
 
-void InfixExpr::bind(Scopes& s) const {
-    lhs->bind(s);
-    rhs->bind(s);
+const AST* Binder::child(const BlockExpr* e, size_t i) {
+    insert_noms(e->stmts, i);
+    return dimpl::child(e, i);
 }
 
-void TupExpr::bind(Scopes& s) const {
-    for (auto&& elem : elems) elem->bind(s);
-    type->bind(s);
-}
+const AST* Binder::child(const ForExpr* e, size_t i) { return detail::nth(i, e->ptrn, e->body); }
 
-void PkExpr::bind(Scopes& s) const {
-    for (auto&& dim : dims) dim->bind(s);
-    body->bind(s);
+const AST* Binder::child(const LetStmt* stmt, size_t i) {
+    if (stmt->init) return detail::nth(i, stmt->init, stmt->ptrn);
+    return detail::nth(i, stmt->ptrn);
 }
 
-void SigExpr::bind(Scopes& s) const {
-    s.push();
-    for (auto&& elem : elems) elem->infiltrate(s);
-    s.pop();
-}
-
-void ArExpr::bind(Scopes& s) const {
-    for (auto&& dim : dims) dim->bind(s);
-    body->bind(s);
-}
-
-void WhileExpr::bind(Scopes& s) const {
-    cond->bind(s);
-    body->bind(s);
-}
-
-/*
- * Stmt
- */
-
-void ExprStmt::bind(Scopes& s) const { expr->bind(s); }
-void NomStmt::bind(Scopes& s) const { nom->bind(s); }
-
-void AssignStmt::bind(Scopes& s) const {
-    lhs->bind(s);
-    rhs->bind(s);
-}
-
-void LetStmt::bind(Scopes& s) const {
-    if (init)
-        init->bind(s);
-    ptrn->bind(s);
-}
+void Binder::exit(const IdBndr* bndr) { s.insert(bndr); }
+void Binder::exit(const IdPtrn* ptrn) { s.insert(ptrn); }
 
 }
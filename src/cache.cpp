@@ -0,0 +1,347 @@
+#include "dimpl/cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "dimpl/flat.h"
+#include "dimpl/parser.h"
+
+namespace dimpl {
+
+namespace {
+
+constexpr char Magic[8] = {'d', 'i', 'm', 'p', 'l', 'a', 's', 't'};
+constexpr u32 Version   = 3;
+
+#define CODE(...) + size_t(1)
+constexpr auto Num_Tags = size_t(0) DIMPL_KEY(CODE) DIMPL_LIT(CODE) DIMPL_TOK(CODE) DIMPL_ASSIGN(CODE) DIMPL_OP(CODE);
+#undef CODE
+
+/*
+ * Span%s and operands are stored as LEB128 varints:
+ * * a Span as its begin relative to that of the previous node plus one - or 0 for Span() - followed by its size;
+ * * an operand either absolute or relative to its node - whichever is shorter - with the choice in the lowest bit.
+ * Most operands are nearby children and most Span%s are close to the previous one; so both mostly take a byte.
+ */
+
+void put(std::string& bytes, u64 u) {
+    for (; u >= 0x80; u >>= 7) bytes.push_back(char(u | 0x80));
+    bytes.push_back(char(u));
+}
+
+/// Yields @c false if @p bytes end in the middle of a varint.
+bool get(std::string_view bytes, size_t& pos, u64& u) {
+    u = 0;
+    for (int shift = 0; pos != bytes.size() && shift < 64; shift += 7) {
+        auto byte = u8(bytes[pos++]);
+        u |= u64(byte & 0x7f) << shift;
+        if (byte < 0x80) return true;
+    }
+    return false;
+}
+
+u64 zigzag(s64 s) { return (u64(s) << 1) ^ u64(s >> 63); }
+s64 unzigzag(u64 u) { return s64(u >> 1) ^ -s64(u & 1); }
+
+/// Byte range of a section relative to the begin of the cache.
+struct Section {
+    u32 offset;
+    u32 size;
+};
+
+struct Header {
+    char magic[8];
+    u32 version;
+    u32 num_nodes; ///< Num_Nodes of the writer: node tags must agree
+    u64 hash;      ///< of the source text
+    u64 size;      ///< of the source text
+    Section nodes, aux, locs, data, extra;
+    Section offsets; ///< for each identifier the offset of its string in @c strs plus one past the last one
+    Section strs;
+};
+
+}
+
+/// Has access to the internals of FlatAST.
+class Cache {
+public:
+    static void write(Comp&, const FlatAST&, const SourceManager::File&, const char* path);
+    static std::optional<FlatAST> read(Comp&, const SourceManager::File&, const char* path);
+
+private:
+    /// Is @p flat laid out as described in flat.h - so unflatten can rely on it?
+    static bool check(const FlatAST& flat);
+};
+
+void Cache::write(Comp& comp, const FlatAST& flat, const SourceManager::File& file, const char* path) {
+    auto text = file.src.text();
+    auto base = file.base;
+
+    // identifiers become indices into the string table; Span%s and operands varints
+    std::unordered_map<u32, u32> sym2idx;
+    std::vector<u32> offsets = {0};
+    std::string strs, locs, data;
+    s64 prev = base;
+    for (FlatAST::Ref ref = 0, e = flat.size(); ref != e; ++ref) {
+        auto lhs = flat.lhs(ref);
+        if (flat.node(ref) == Node::Id) {
+            auto [i, ins] = sym2idx.emplace(lhs, u32(offsets.size() - 1));
+            if (ins) {
+                strs.append(comp.syms().sym(lhs).str());
+                offsets.emplace_back(u32(strs.size()));
+            }
+            lhs = i->second;
+        }
+
+        for (auto op : {lhs, flat.rhs(ref)}) {
+            auto rel = zigzag(s64(ref) - s64(op));
+            put(data, rel < op ? rel << 1 | 1 : u64(op) << 1);
+        }
+
+        if (auto loc = flat.loc(ref); loc == Span()) {
+            put(locs, 0);
+        } else {
+            put(locs, zigzag(loc.begin - prev) + 1);
+            put(locs, loc.finis - loc.begin);
+            prev = loc.begin;
+        }
+    }
+
+    Header header = {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version   = Version;
+    header.num_nodes = u32(Num_Nodes);
+    header.hash      = hash_source(text);
+    header.size      = text.size();
+
+    std::string bytes(sizeof(Header), '\0');
+    auto section = [&](const auto& vec) {
+        bytes.resize((bytes.size() + 7) & ~size_t(7)); // keep sections 8-byte aligned
+        auto size = vec.size() * sizeof(vec[0]);
+        if (bytes.size() + size > u32(-1)) throw std::runtime_error(std::string("cache '") + path + "' exceeds 4 GiB");
+        Section res{u32(bytes.size()), u32(size)};
+        bytes.append(reinterpret_cast<const char*>(vec.data()), size);
+        return res;
+    };
+    header.nodes   = section(flat.nodes_);
+    header.aux     = section(flat.aux_);
+    header.locs    = section(locs);
+    header.data    = section(data);
+    header.extra   = section(flat.extra_);
+    header.offsets = section(offsets);
+    header.strs    = section(strs);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+
+    // write to a temporary and rename it, so a concurrent reader never sees a partial cache
+    auto tmp = std::string(path) + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        ofs.write(bytes.data(), std::streamsize(bytes.size()));
+        if (!ofs) throw std::runtime_error("cannot write cache '" + tmp + "'");
+    }
+    if (std::rename(tmp.c_str(), path) != 0) throw std::runtime_error(std::string("cannot write cache '") + path + "'");
+}
+
+bool Cache::check(const FlatAST& flat) {
+    using Ref = FlatAST::Ref;
+    auto num_extra = flat.extra_.size();
+
+    // children precede their parent
+    auto in = [&](Ref parent, Ref ref, int first, int last) {
+        return ref < parent && first <= flat.node(ref) && flat.node(ref) <= last;
+    };
+    auto is = [&](Ref parent, Ref ref, int node) { return in(parent, ref, node, node); };
+    auto id   = [&](Ref parent, Ref ref) { return is(parent, ref, Node::Id); };
+    auto nom  = [&](Ref parent, Ref ref) { return in(parent, ref, Node::NomNom,     Node::SigNom);  };
+    auto bndr = [&](Ref parent, Ref ref) { return in(parent, ref, Node::ErrBndr,    Node::SigBndr); };
+    auto ptrn = [&](Ref parent, Ref ref) { return in(parent, ref, Node::ErrPtrn,    Node::TupPtrn); };
+    auto stmt = [&](Ref parent, Ref ref) { return in(parent, ref, Node::AssignStmt, Node::NomStmt); };
+    auto elem = [&](Ref parent, Ref ref) { return is(parent, ref, Node::TupElem); };
+    auto expr = [&](Ref parent, Ref ref) {
+        return in(parent, ref, Node::AbsExpr, Node::WhileExpr) && flat.node(ref) != Node::TupElem;
+    };
+    auto opt  = [&](Ref parent, Ref ref) { return ref == FlatAST::None || expr(parent, ref); };
+    auto ops  = [&](Ref ref, u32 n) { return flat.lhs(ref) <= num_extra && num_extra - flat.lhs(ref) >= n; };
+    auto op   = [&](Ref ref, u32 i) { return flat.extra(flat.lhs(ref) + i); };
+    auto list = [&](Ref parent, u32 list, auto pred) {
+        return list < num_extra && flat.extra(list) < num_extra - list
+            && std::ranges::all_of(flat.list(list), [&](Ref ref) { return pred(parent, ref); });
+    };
+
+    for (Ref ref = 0, e = Ref(flat.size()); ref != e; ++ref) {
+        auto lhs = flat.lhs(ref);
+        auto rhs = flat.rhs(ref);
+        auto tag = size_t(flat.tag(ref)) < Num_Tags;
+
+        bool ok;
+        switch (flat.node(ref)) {
+            case Node::Prg:         ok = ref == flat.root() && list(ref, lhs, stmt); break;
+            case Node::NomNom:      ok = ops(ref, 3) && id(ref, op(ref, 0)) && expr(ref, op(ref, 1))
+                                      && expr(ref, op(ref, 2)); break;
+            case Node::AbsNom:      ok = tag && ops(ref, 4) && id(ref, op(ref, 0)) && list(ref, op(ref, 1), ptrn)
+                                      && expr(ref, op(ref, 2)) && expr(ref, op(ref, 3)); break;
+            case Node::SigNom:
+            case Node::IdExpr:
+            case Node::VarExpr:     ok = id(ref, lhs); break;
+            case Node::IdBndr:
+            case Node::IdPtrn:
+            case Node::TupElem:     ok = id(ref, lhs) && expr(ref, rhs); break;
+            case Node::SigBndr:
+            case Node::SigExpr:     ok = list(ref, lhs, bndr); break;
+            case Node::TupPtrn:     ok = list(ref, lhs, ptrn); break;
+            case Node::AssignStmt:
+            case Node::InfixExpr:   ok = tag && expr(ref, lhs) && expr(ref, rhs); break;
+            case Node::ExprStmt:    ok = expr(ref, lhs); break;
+            case Node::LetStmt:     ok = ptrn(ref, lhs) && opt(ref, rhs); break;
+            case Node::NomStmt:     ok = nom(ref, lhs); break;
+            case Node::AbsExpr:     ok = is(ref, lhs, Node::AbsNom); break;
+            case Node::TupExpr:     ok = list(ref, lhs, elem) && expr(ref, rhs); break;
+            case Node::AppExpr:     ok = tag && expr(ref, lhs) && is(ref, rhs, Node::TupExpr); break;
+            case Node::BlockExpr:   ok = list(ref, lhs, stmt) && expr(ref, rhs); break;
+            case Node::FieldExpr:   ok = expr(ref, lhs) && id(ref, rhs); break;
+            case Node::ForExpr:     ok = ops(ref, 3) && ptrn(ref, op(ref, 0)) && expr(ref, op(ref, 1))
+                                      && is(ref, op(ref, 2), Node::BlockExpr); break;
+            case Node::IfExpr:      ok = ops(ref, 3) && expr(ref, op(ref, 0)) && expr(ref, op(ref, 1))
+                                      && expr(ref, op(ref, 2)); break;
+            case Node::PkExpr:
+            case Node::ArExpr:      ok = list(ref, lhs, bndr) && expr(ref, rhs); break;
+            case Node::PiExpr:      ok = tag && list(ref, lhs, bndr) && opt(ref, rhs); break;
+            case Node::PrefixExpr:
+            case Node::PostfixExpr: ok = tag && expr(ref, lhs); break;
+            case Node::WhileExpr:   ok = expr(ref, lhs) && is(ref, rhs, Node::BlockExpr); break;
+            case Node::LitExpr:     ok = flat.tag(ref) == Tok::Tag::L_f || flat.tag(ref) == Tok::Tag::L_s
+                                      || flat.tag(ref) == Tok::Tag::L_u; break;
+            case Node::KeyExpr:     ok = size_t(flat.tag(ref)) < Num_Keys; break;
+            case Node::Id:
+            case Node::ErrBndr:
+            case Node::ErrPtrn:
+            case Node::BottomExpr:
+            case Node::ErrExpr:
+            case Node::UnkExpr:     ok = true; break;
+            default:                ok = false; break; // abstract or never flattened
+        }
+        if (!ok) return false;
+    }
+
+    return flat.node(flat.root()) == Node::Prg;
+}
+
+std::optional<FlatAST> Cache::read(Comp& comp, const SourceManager::File& file, const char* path) {
+    std::optional<Source> map;
+    try {
+        map.emplace(path);
+    } catch (const std::runtime_error&) {
+        return {};
+    }
+
+    auto bytes = map->text();
+    auto text  = file.src.text();
+    Header header;
+    if (bytes.size() < sizeof(header)) return {};
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+            || header.num_nodes != u32(Num_Nodes) || header.size != text.size() || header.hash != hash_source(text))
+        return {};
+
+    auto valid = [&](Section s, size_t elem_size) {
+        return s.offset <= bytes.size() && s.size <= bytes.size() - s.offset && s.size % elem_size == 0;
+    };
+    auto section = [&](Section s, auto& vec) {
+        if (!valid(s, sizeof(vec[0]))) return false;
+        vec.resize(s.size / sizeof(vec[0]));
+        std::memcpy(vec.data(), bytes.data() + s.offset, s.size);
+        return true;
+    };
+
+    FlatAST flat;
+    std::vector<u32> offsets;
+    if (!section(header.nodes, flat.nodes_) || !section(header.aux, flat.aux_) || !section(header.extra, flat.extra_)
+            || !section(header.offsets, offsets) || !valid(header.locs, 1) || !valid(header.data, 1)
+            || !valid(header.strs, 1))
+        return {};
+    auto n = flat.size();
+    if (n == 0 || flat.aux_.size() != n || offsets.empty()) return {};
+
+    // intern each identifier once
+    auto strs = bytes.substr(header.strs.offset, header.strs.size);
+    std::vector<u32> ids(offsets.size() - 1);
+    for (size_t i = 0, e = ids.size(); i != e; ++i) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > strs.size()) return {};
+        ids[i] = comp.sym(strs.substr(offsets[i], offsets[i + 1] - offsets[i])).id();
+    }
+
+    auto locs = bytes.substr(header.locs.offset, header.locs.size);
+    auto data = bytes.substr(header.data.offset, header.data.size);
+    flat.locs_.resize(n);
+    flat.data_.resize(n);
+    size_t loc_pos = 0, data_pos = 0;
+    s64 prev = file.base;
+    for (FlatAST::Ref ref = 0; ref != n; ++ref) {
+        u64 ops[2];
+        for (auto& op : ops) {
+            if (!get(data, data_pos, op)) return {};
+            op = op & 1 ? u64(s64(ref) - unzigzag(op >> 1)) : op >> 1;
+        }
+        if (flat.node(ref) == Node::Id) {
+            if (ops[0] >= ids.size()) return {};
+            ops[0] = ids[ops[0]];
+        }
+        flat.data_[ref] = {u32(ops[0]), u32(ops[1])};
+
+        u64 begin, size;
+        if (!get(locs, loc_pos, begin)) return {};
+        if (begin != 0) {
+            if (!get(locs, loc_pos, size)) return {};
+            prev += unzigzag(begin - 1);
+            if (prev < file.base || prev > s64(file.base + text.size()) || size > file.base + text.size() - prev)
+                return {};
+            flat.locs_[ref] = Span(u32(prev), u32(prev + size));
+        }
+    }
+
+    if (!check(flat)) return {};
+    return flat;
+}
+
+void write_cache(Comp& comp, const Prg* prg, const char* path) {
+    Cache::write(comp, flatten(prg), comp.srcs().file(prg->loc.begin), path);
+}
+
+Ptr<Prg> read_cache(Comp& comp, const SourceManager::File& file, const char* path) {
+    if (auto flat = Cache::read(comp, file, path)) return unflatten(comp, *flat);
+    return nullptr;
+}
+
+Ptr<Prg> parse_file(Comp& comp, const char* file, const char* cache) {
+    auto& f = comp.srcs().add(Source(file));
+    if (auto prg = read_cache(comp, f, cache)) return prg;
+
+    auto num_errors   = comp.num_errors();
+    auto num_warnings = comp.num_warnings();
+    auto prg = parse_parallel(comp, lex_parallel(comp, f));
+    auto flat = flatten(prg); // parses the bodies skipped by Comp::lazy - and reports their diagnostics
+    if (comp.num_errors() == num_errors && comp.num_warnings() == num_warnings) {
+        try {
+            Cache::write(comp, flat, f, cache);
+        } catch (const std::runtime_error& e) {
+            comp.warn("{}", e.what());
+        }
+    }
+
+    return prg;
+}
+
+u64 hash_source(std::string_view text) {
+    // FNV-1a
+    u64 hash = 0xcbf29ce484222325_u64;
+    for (unsigned char c : text) hash = (hash ^ c) * 0x100000001b3_u64;
+    return hash;
+}
+
+}
@@ -1,13 +1,111 @@
 #include "dimpl/comp.h"
 
+#include <bit>
+
+#include "dimpl/ast.h"
+
 namespace dimpl {
 
+/*
+ * Comp
+ */
+
+static constexpr auto by_parent = [](const auto& l, const auto& r) { return l.parent < r.parent; };
+
+Comp::Comp()
+    : anonymous_(sym("_"))
+    , error_(sym("<error>"))
+{
+    size_t i = 0;
+#define CODE(t, str) keys_[i] = sym(str); key_exprs_[i] = mk_canonical<KeyExpr>(Tok(Span(), Tok::Tag(i))); ++i;
+    DIMPL_KEY(CODE)
+#undef CODE
+    unk_expr_ = mk_canonical<UnkExpr>(Span());
+    unit_tup_ = mk_canonical<TupExpr>(Span(), Ptrs<TupElem>(), unk_expr_);
+}
+
+Comp::Mark Comp::mark() {
+    std::lock_guard<std::mutex> guard(leaves_mutex_);
+    return {arena().mark(), leaf_locs_.size()};
+}
+
+void Comp::rewind(Mark mark) {
+    {
+        std::lock_guard<std::mutex> guard(leaves_mutex_);
+        std::erase_if(leaf_locs_begin_, [&](const auto& l) { return l.begin >= mark.num_leaf_locs; });
+        leaf_locs_sorted_ = std::is_sorted_until(leaf_locs_begin_.begin(), leaf_locs_begin_.end(), by_parent) - leaf_locs_begin_.begin();
+        leaf_locs_.resize(mark.num_leaf_locs);
+    }
+    arena().rewind(mark.arena);
+}
+
+Ptr<LitExpr> Comp::lit_expr(Tok tok) {
+    std::lock_guard<std::mutex> guard(leaves_mutex_);
+    switch (tok.tag()) {
+        case Tok::Tag::L_f: {
+            auto& lit = lit_exprs_[0][std::bit_cast<u64>(tok.f())];
+            if (lit == nullptr) lit = mk_canonical<LitExpr>(Tok(Span(), tok.f()));
+            return lit;
+        }
+        case Tok::Tag::L_s: {
+            auto& lit = lit_exprs_[1][std::bit_cast<u64>(tok.s())];
+            if (lit == nullptr) lit = mk_canonical<LitExpr>(Tok(Span(), tok.s()));
+            return lit;
+        }
+        case Tok::Tag::L_u: {
+            auto& lit = lit_exprs_[2][tok.u()];
+            if (lit == nullptr) lit = mk_canonical<LitExpr>(Tok(Span(), tok.u()));
+            return lit;
+        }
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+bool Comp::is_leaf(const AST* ast) const {
+    return isa<KeyExpr>(ast) || isa<LitExpr>(ast) || isa<UnkExpr>(ast) || ast == unit_tup_;
+}
+
+void Comp::set_leaf_locs(const AST* parent, std::span<const Span> locs) {
+    std::lock_guard<std::mutex> guard(leaves_mutex_);
+    leaf_locs_begin_.push_back({parent, u32(leaf_locs_.size())});
+    leaf_locs_.insert(leaf_locs_.end(), locs.begin(), locs.end());
+}
+
+const Span* Comp::find_leaf_locs(const AST* parent) const {
+    auto& locs = leaf_locs_begin_;
+    if (leaf_locs_sorted_ != locs.size()) {
+        auto mid = locs.begin() + leaf_locs_sorted_;
+        std::sort(mid, locs.end(), by_parent);
+        std::inplace_merge(locs.begin(), mid, locs.end(), by_parent);
+        leaf_locs_sorted_ = locs.size();
+    }
+
+    auto i = std::lower_bound(locs.begin(), locs.end(), parent, [](const auto& l, const AST* p) { return l.parent < p; });
+    return i != locs.end() && i->parent == parent ? leaf_locs_.data() + i->begin : nullptr;
+}
+
+Span Comp::leaf_loc(const AST* parent, size_t i) const {
+    std::lock_guard<std::mutex> guard(leaves_mutex_);
+    auto locs = find_leaf_locs(parent);
+    return locs ? locs[i] : Span();
+}
+
+bool Comp::has_leaf_locs(const AST* parent) const {
+    std::lock_guard<std::mutex> guard(leaves_mutex_);
+    return find_leaf_locs(parent) != nullptr;
+}
+
+/*
+ * Tok
+ */
+
 Stream& Tok::stream(Stream& s) const {
     switch (tag()) {
-        case Tok::Tag::L_s:  return s << s64();
-        case Tok::Tag::L_u:  return s << u64();
-        case Tok::Tag::L_f:  return s << f64();
-        default:             return s << sym();
+        case Tok::Tag::L_s:  return s << this->s();
+        case Tok::Tag::L_u:  return s << u();
+        case Tok::Tag::L_f:  return s << f();
+        case Tok::Tag::M_id: return s << sym();
+        default:             return s << tag2str(tag());
     }
 }
 
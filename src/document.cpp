@@ -0,0 +1,143 @@
+#include "dimpl/document.h"
+
+#include <algorithm>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+
+#include "dimpl/parser.h"
+#include "dimpl/scan.h"
+
+namespace dimpl {
+
+Document::Document(Comp& comp, Source&& src, size_t space)
+    : comp_(comp)
+    , space_(space)
+    , toks_(lex_parallel(comp, std::move(src)))
+    , first_(&comp.srcs().file(toks_.offset(0)))
+    , file_(first_)
+{
+    num_relexed_ = toks_.size();
+    parse({}, 0, 0, 0);
+}
+
+Ptr<Prg> Document::edit(size_t offset, size_t removed, std::string_view inserted) {
+    auto old_text = text();
+    if (offset > old_text.size() || removed > old_text.size() - offset)
+        throw std::out_of_range("edit exceeds the document");
+
+    std::string str;
+    str.reserve(old_text.size() - removed + inserted.size());
+    str.append(old_text.substr(0, offset)).append(inserted).append(old_text.substr(offset + removed));
+
+    // rebase instead of exhausting the offset space
+    if (file_->base + old_text.size() + str.size() + 2 - first_->base > space_) {
+        file_ = first_ = &comp_.srcs().rebase(*first_, Source(std::move(str), file_->src.filename()));
+        toks_ = lex_parallel(comp_, *file_);
+        num_relexed_ = toks_.size();
+        parse({}, 0, 0, 0);
+        return prg_;
+    }
+
+    auto old_base = file_->base;
+    file_ = &comp_.srcs().edit(*file_, Source(std::move(str), file_->src.filename()), u32(offset), u32(removed),
+                               u32(inserted.size()));
+    auto base = file_->base;
+    auto text = this->text();
+    auto suffix = offset + inserted.size(); // begin of the unchanged rest in text
+
+    // keep all Tok%s in front of the edit - the Lexer peeks one byte past a Tok
+    auto old = std::move(toks_);
+    auto eof = old.size() - 1;
+    auto indices = std::views::iota(size_t(0), eof);
+    size_t keep = std::ranges::partition_point(indices, [&](size_t i) { return old.finis(i) < old_base + offset; })
+                - indices.begin();
+
+    // lex from there on until a Tok ends where one ended before: from then on, both Lexers see the same text
+    auto begin = keep == 0 ? size_t(0) : size_t(old.finis(keep - 1) - old_base);
+    Toks relexed(comp_);
+    size_t resync = 0; // first old Tok that is reused
+    Comp::Diags diags;
+    for (size_t window = Window; true; window *= 2) {
+        auto end = std::min(text.size(), suffix + window);
+        if (end != text.size()) end = scan::find(text.data() + end, text.data() + text.size(), '\n') + 1 - text.data();
+        end = std::min(end, text.size());
+
+        diags = {};
+        Comp::Capture capture(diags);
+        Lexer lexer(comp_, *file_, begin, end, false, comp_.max_errors);
+        relexed = Toks(comp_);
+        for (size_t j = keep; true;) {
+            auto tok = lexer.lex();
+            relexed.push_back(tok);
+            if (tok.isa(Tok::Tag::M_eof)) break;
+
+            auto finis = tok.loc().finis - base;
+            if (finis < suffix) continue;
+            auto old_finis = old_base + u32(finis - inserted.size() + removed);
+            while (j != eof && old.finis(j) < old_finis) ++j;
+            if (j != eof && old.finis(j) == old_finis) {
+                resync = j + 1;
+                break;
+            }
+        }
+
+        if (resync != 0) break;
+        if (end == text.size() || !lexer.valid()) { // the whole rest has been lexed
+            if (lexer.ends_in_comment()) {
+                auto eof_begin = relexed.offset(relexed.size() - 1);
+                comp_.err(Span(*lexer.comment_begin(), eof_begin), "non-terminated multiline comment");
+            }
+            resync = old.size();
+            break;
+        }
+    }
+    comp_.flush(diags);
+
+    toks_ = Toks(comp_);
+    toks_.append(old, 0, keep, base - old_base);
+    toks_.append(relexed);
+    toks_.append(old, resync, old.size(), base - old_base + u32(inserted.size()) - u32(removed));
+    num_relexed_ = relexed.size();
+
+    // keep all Stmt%s whose parse - including the lookahead - did not reach into the damage
+    auto old_stmts = std::move(stmts_);
+    size_t num_kept = std::ranges::partition_point(old_stmts, [&](const Range& range) {
+        return range.end + Parser::max_ahead <= keep;
+    }) - old_stmts.begin();
+    parse(old_stmts, num_kept, keep + relexed.size(), resync);
+    return prg_;
+}
+
+void Document::parse(const std::vector<Range>& old, size_t num_kept, size_t damage_end, size_t resync) {
+    stmts_.assign(old.begin(), old.begin() + num_kept);
+    num_reparsed_ = 0;
+
+    auto eof = toks_.size() - 1;
+    Parser parser(comp_, toks_, num_kept == 0 ? 0 : old[num_kept - 1].end, eof);
+    auto shift = damage_end - resync; // modulo 2^64
+    auto i = std::ranges::lower_bound(old.begin() + num_kept, old.end(), resync, {}, &Range::begin);
+    while (true) {
+        // from a boundary behind the damage on, the Parser sees the same Tok%s as before
+        auto cursor = parser.cursor();
+        if (cursor >= damage_end) {
+            while (i != old.end() && i->begin + shift < cursor) ++i;
+            if (i != old.end() && i->begin + shift == cursor) {
+                for (; i != old.end(); ++i) stmts_.emplace_back(i->stmt, i->begin + shift, i->end + shift);
+                break;
+            }
+        }
+
+        auto stmt = parser.parse_stmt();
+        if (stmt == nullptr) break;
+        stmts_.emplace_back(stmt, cursor, parser.cursor());
+        ++num_reparsed_;
+    }
+
+    PtrsBuilder<Stmt> stmts;
+    for (const auto& range : stmts_) stmts.emplace_back(range.stmt);
+    auto finis = eof == 0 ? toks_.offset(0) : toks_.finis(eof - 1);
+    prg_ = comp_.mk<Prg>(Span(toks_.offset(0), finis), comp_.mk_ptrs(stmts));
+}
+
+}
@@ -1,6 +1,6 @@
 #include "dimpl/emit.h"
 
-#include "dimpl/ast.h"
+#include "dimpl/visit.h"
 
 namespace dimpl {
 
@@ -10,29 +10,34 @@ using DefArray = thorin::Array<const thorin::Def*>;
  * Emitter
  */
 
-const thorin::Def* Emitter::dbg(Loc loc) {
-    return world().dbg(loc);
+const thorin::Def* Emitter::dbg(Span loc) {
+    return world().dbg(comp.loc(loc));
+}
+
+void Emitter::emit(const Prg* prg) {
+    walk(prg);
+    assert(defs_.empty());
 }
 
 void Emitter::emit_stmts(const Ptrs<Stmt>& stmts) {
-    for (auto i = stmts.begin(), e = stmts.end(); i != e;) {
-        if (isa<NomStmt>(*i)) {
-            for (auto j = i; j != e && isa<NomStmt>(*j); ++j)
-                as<NomStmt>(*j)->nom.get()->emit_nom(*this);
-            for (; i != e && isa<NomStmt>(*i); ++i)
-                as<NomStmt>(*i)->nom->emit(*this);
-        } else {
-            (*i)->emit(*this);
-            ++i;
-        }
+    for (size_t i = 0, e = stmts.size(); i != e; ++i) {
+        emit_noms(stmts, i);
+        walk(stmts[i]);
     }
 }
 
-/*
- * Misc
- */
+void Emitter::emit_noms(const Ptrs<Stmt>& stmts, size_t i) {
+    if (i >= stmts.size() || !isa<NomStmt>(stmts[i]) || (i != 0 && isa<NomStmt>(stmts[i - 1]))) return;
+    for (size_t e = stmts.size(); i != e && isa<NomStmt>(stmts[i]); ++i)
+        emit_nom(as<NomStmt>(stmts[i])->nom);
+}
+
+void Emitter::emit_nom(const Nom* ast) { visit(ast, [this](auto ast) { emit_nom(ast); }); }
 
-void Prg::emit(Emitter& e) const { e.emit_stmts(stmts); }
+const AST* Emitter::child(const Prg* prg, size_t i) {
+    emit_noms(prg->stmts, i);
+    return dimpl::child(prg, i);
+}
 
 /*
  * Nom
@@ -41,205 +46,204 @@ void Prg::emit(Emitter& e) const { e.emit_stmts(stmts); }
 //(A)(B)(C) -> D {
 //}
 
-void AbsNom::emit_nom(Emitter& /*e*/) const {
-    size_t n = doms.size();
+void Emitter::emit_nom(const AbsNom* abs) {
+    size_t n = abs->doms.size();
 
     thorin::Array<thorin::Pi*> pis(n, [&](size_t /*i*/) {
-        //auto t = doms[i]->emit(e);
-        //return e.world().nom_unk(t);
+        //auto t = emit(abs->doms[i]);
+        //return world().nom_unk(t);
         return nullptr;
     });
 
-    for (auto&& dom : doms) {
+    for (auto&& dom : abs->doms) {
         dom->dump();
     }
 }
 
-void NomNom::emit_nom(Emitter& /*e*/) const {
-}
-
-void AbsNom::emit(Emitter& /*e*/) const {
+void Emitter::emit_nom(const NomNom*) {
 }
 
-void NomNom::emit(Emitter& /*e*/) const {
-}
-
-/*
- * Bndr
- */
-
-const thorin::Def* ErrBndr::emit(Emitter&, const thorin::Def*) const { THORIN_UNREACHABLE; }
-
-const thorin::Def* IdBndr::emit(Emitter& e, const thorin::Def* d) const {
-    def = d;
-    type->emit(e);
-    return d;
-}
-
-const thorin::Def* SigBndr::emit(Emitter&, const thorin::Def*) const {
-    return nullptr;
+void Emitter::emit_nom(const SigNom*) {
 }
 
 /*
  * Ptrn
  */
 
-void IdPtrn::emit(Emitter&, const thorin::Def* d) const {
-    def = d;
+bool Emitter::enter(const IdPtrn* ptrn) {
+    ptrn->def = defs_.back();
+    return false;
 }
 
-void TupPtrn::emit(Emitter& e, const thorin::Def* def) const {
-    size_t n = elems.size();
-    for (size_t i = 0; i != n; ++i)
-        elems[i]->emit(e, e.world().extract(def, n, i, e.dbg(elems[i]->loc)));
+const AST* Emitter::child(const TupPtrn* ptrn, size_t i) {
+    size_t n = ptrn->elems.size();
+    if (i != 0) defs_.pop_back();
+    if (i == n) return nullptr;
+    defs_.push_back(world().extract(defs_.back(), n, i, dbg(ptrn->elems[i]->loc)));
+    return ptrn->elems[i];
 }
 
-void ErrPtrn::emit(Emitter&, const thorin::Def*) const {}
-
 /*
  * Stmt
  */
 
-void ExprStmt::emit(Emitter& e) const { expr->emit(e); }
-void NomStmt::emit(Emitter& e) const { nom->emit(e); }
+bool Emitter::enter(const NomStmt*) { return false; }
+
+void Emitter::exit(const ExprStmt*) { defs_.pop_back(); }
 
-void AssignStmt::emit(Emitter& e) const {
-    lhs->emit(e);
-    rhs->emit(e);
+void Emitter::exit(const AssignStmt*) {
+    defs_.pop_back();
+    defs_.pop_back();
 }
 
-void LetStmt::emit(Emitter& e) const {
-    auto i = init ? init->emit(e) : e.world().bot(e.world().type());
-    i->dump(0);
-    ptrn->emit(e, i);
+const AST* Emitter::child(const LetStmt* stmt, size_t i) {
+    if (stmt->init && i == 0) return stmt->init;
+    if (i == (stmt->init ? 1 : 0)) {
+        if (!stmt->init) defs_.push_back(world().bot(world().type()));
+        defs_.back()->dump(0);
+        return stmt->ptrn;
+    }
+    return nullptr;
 }
 
+void Emitter::exit(const LetStmt*) { defs_.pop_back(); }
+
 /*
  * Expr
  */
 
-const thorin::Def* UnkExpr::emit(Emitter& e) const { return e.world().nom_unk(e.dbg(loc)); }
+void Emitter::exit(const UnkExpr*) { defs_.push_back(world().nom_unk(dbg(Walker::loc()))); }
+
+const AST* Emitter::child(const AbsExpr*, size_t) { return nullptr; }
+void Emitter::exit(const AbsExpr* e) { defs_.push_back(e->abs->def); }
 
-const thorin::Def* AbsExpr::emit(Emitter& e) const {
-    abs->emit(e);
-    return abs->def;
+void Emitter::exit(const AppExpr* e) {
+    auto a = pop();
+    auto c = pop();
+    defs_.push_back(world().app(c, a, dbg(e->loc)));
 }
 
-const thorin::Def* AppExpr::emit(Emitter& e) const {
-    auto c = callee->emit(e);
-    auto a = arg->emit(e);
-    return e.world().app(c, a, e.dbg(loc));
+const AST* Emitter::child(const ArExpr* e, size_t i) {
+    //for (auto&& dom : e->doms)
+        //emit(dom);
+    return detail::nth(i, e->body);
 }
 
-const thorin::Def* ArExpr::emit(Emitter& e) const {
-    //for (auto&& dom : doms)
-        //dom->emit(e);
-    body->emit(e);
-    return nullptr;
+void Emitter::exit(const ArExpr*) {
+    defs_.back() = nullptr;
 }
 
-const thorin::Def* BlockExpr::emit(Emitter& e) const {
-    e.emit_stmts(stmts);
-    return expr->emit(e);
+const AST* Emitter::child(const BlockExpr* e, size_t i) {
+    emit_noms(e->stmts, i);
+    return dimpl::child(e, i);
 }
 
-const thorin::Def* BottomExpr::emit(Emitter&) const {
-    return nullptr;
+void Emitter::exit(const BottomExpr*) {
+    defs_.push_back(nullptr);
 }
 
-const thorin::Def* ErrExpr::emit(Emitter& e) const {
-    return e.world().bot(e.world().type());
+void Emitter::exit(const ErrExpr*) {
+    defs_.push_back(world().bot(world().type()));
 }
 
-const thorin::Def* FieldExpr::emit(Emitter& e) const {
-    lhs->emit(e);
-    return nullptr;
+void Emitter::exit(const FieldExpr*) {
+    defs_.back() = nullptr;
 }
 
-const thorin::Def* IdExpr::emit(Emitter&) const { return decl->def; }
+void Emitter::exit(const IdExpr* e) { defs_.push_back(e->decl->def); }
 
-const thorin::Def* IfExpr::emit(Emitter& e) const {
-    cond->emit(e);
-    then_expr->emit(e);
-    else_expr->emit(e);
-    return nullptr;
+void Emitter::exit(const IfExpr*) {
+    defs_.resize(defs_.size() - 2);
+    defs_.back() = nullptr;
 }
 
-const thorin::Def* InfixExpr::emit(Emitter& e) const {
-    lhs->emit(e);
-    rhs->emit(e);
-    return nullptr;
+void Emitter::exit(const InfixExpr*) {
+    defs_.pop_back();
+    defs_.back() = nullptr;
 }
 
-const thorin::Def* LitExpr::emit(Emitter& /*e*/) const {
-    return nullptr;
+void Emitter::exit(const LitExpr*) {
+    defs_.push_back(nullptr);
 }
 
-const thorin::Def* PiExpr::emit(Emitter& e) const {
-    codom->emit(e);
-    return nullptr;
+void Emitter::exit(const MatchExpr*) {
+    defs_.push_back(nullptr);
+}
+
+const AST* Emitter::child(const PiExpr* e, size_t i) { return detail::nth(i, e->codom); }
+
+void Emitter::exit(const PiExpr* e) {
+    if (e->codom) defs_.pop_back();
+    defs_.push_back(nullptr);
 }
 
-const thorin::Def* PkExpr::emit(Emitter& e) const {
+const AST* Emitter::child(const PkExpr* e, size_t i) {
 #if 0
-    size_t n = doms.size();
+    size_t n = e->doms.size();
     DefArray ds(n);
     for (size_t i = 0; i != n; ++i)
-        ds[i] = doms[i]->emit(e);
-    return e.world().pack(ds, b, e.dbg(loc));
+        ds[i] = emit(e->doms[i]);
+    return world().pack(ds, b, dbg(e->loc));
 #endif
-    body->emit(e);
-    return nullptr;
+    return detail::nth(i, e->body);
 }
 
-const thorin::Def* PrefixExpr::emit(Emitter& e) const {
-    rhs->emit(e);
-    return nullptr;
+void Emitter::exit(const PkExpr*) {
+    defs_.back() = nullptr;
 }
 
-const thorin::Def* PostfixExpr::emit(Emitter& e) const {
-    lhs->emit(e);
-    return nullptr;
+void Emitter::exit(const PrefixExpr*) {
+    defs_.back() = nullptr;
+}
+
+void Emitter::exit(const PostfixExpr*) {
+    defs_.back() = nullptr;
 }
 
-const thorin::Def* SigExpr::emit(Emitter& /*e*/) const {
+const AST* Emitter::child(const SigExpr*, size_t) {
 #if 0
-    size_t n = elems.size();
-    DefArray es(n, [&](size_t i) { return elems[i]->emit(e, s->var(n, i, dbg(...)); });
-    return e.world().sigma(es, e.dbg(loc));
+    size_t n = e->elems.size();
+    DefArray es(n, [&](size_t i) { return emit(e->elems[i], s->var(n, i, dbg(...)); });
+    return world().sigma(es, dbg(e->loc));
 #endif
     return nullptr;
 }
 
-const thorin::Def* TupElem::emit(Emitter& e) const {
-    return expr->emit(e);
+void Emitter::exit(const SigExpr*) {
+    defs_.push_back(nullptr);
 }
 
-const thorin::Def* TupExpr::emit(Emitter& e) const {
-    DefArray args(elems.size(), [&](size_t i) { return elems[i]->emit(e); });
-    auto t = type->emit(e);
-    return e.world().tuple(t, args, e.dbg(loc));
+void Emitter::exit(const TupExpr* e) {
+    auto t = pop();
+    size_t n = e->elems.size();
+    DefArray args(n, [&](size_t i) { return defs_[defs_.size() - n + i]; });
+    defs_.resize(defs_.size() - n);
+    defs_.push_back(world().tuple(t, args, dbg(Walker::loc())));
 }
 
-const thorin::Def* VarExpr::emit(Emitter& /*e*/) const {
-    return nullptr;
+void Emitter::exit(const VarExpr*) {
+    defs_.push_back(nullptr);
 }
 
-const thorin::Def* ForExpr::emit(Emitter& /*e*/) const {
-    return nullptr;
+const AST* Emitter::child(const ForExpr*, size_t) { return nullptr; }
+
+void Emitter::exit(const ForExpr*) {
+    defs_.push_back(nullptr);
 }
 
-const thorin::Def* KeyExpr::emit(Emitter& e) const {
-    switch (tag) {
-        case Tok::Tag::K_Type: return e.world().type();
-        case Tok::Tag::K_Kind: return e.world().kind();
-        case Tok::Tag::K_Nat:  return e.world().type_nat();
+void Emitter::exit(const KeyExpr* e) {
+    switch (e->tag) {
+        case Tok::Tag::K_Type: defs_.push_back(world().type());     break;
+        case Tok::Tag::K_Kind: defs_.push_back(world().kind());     break;
+        case Tok::Tag::K_Nat:  defs_.push_back(world().type_nat()); break;
         default: THORIN_UNREACHABLE;
     }
 }
 
-const thorin::Def* WhileExpr::emit(Emitter& /*e*/) const {
-    return nullptr;
+const AST* Emitter::child(const WhileExpr*, size_t) { return nullptr; }
+
+void Emitter::exit(const WhileExpr*) {
+    defs_.push_back(nullptr);
 }
 
 }
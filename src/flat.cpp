@@ -0,0 +1,759 @@
+#include "dimpl/flat.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "dimpl/emit.h"
+
+namespace dimpl {
+
+using Ref = FlatAST::Ref;
+using DefArray = thorin::Array<const thorin::Def*>;
+
+/*
+ * FlatAST
+ */
+
+Ref FlatAST::add(int node, Span loc, u8 aux, u32 lhs, u32 rhs) {
+    auto ref = Ref(size());
+    nodes_.emplace_back(node);
+    aux_  .emplace_back(aux);
+    locs_ .emplace_back(loc);
+    data_ .emplace_back(Data{lhs, rhs});
+    return ref;
+}
+
+Ref FlatAST::decl_id(Ref ref) const {
+    switch (node(ref)) {
+        case Node::NomNom:
+        case Node::AbsNom: return extra(lhs(ref));
+        case Node::SigNom:
+        case Node::IdBndr:
+        case Node::IdPtrn: return lhs(ref);
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+/*
+ * flatten
+ */
+
+u32 Flattener::extra(std::initializer_list<u32> ops) {
+    auto res = u32(flat_.extra_.size());
+    flat_.extra_.insert(flat_.extra_.end(), ops);
+    return res;
+}
+
+u32 Flattener::list(std::span<const Ref> refs) {
+    auto res = u32(flat_.extra_.size());
+    flat_.extra_.emplace_back(u32(refs.size()));
+    flat_.extra_.insert(flat_.extra_.end(), refs.begin(), refs.end());
+    return res;
+}
+
+template<class T>
+u32 Flattener::list(const Ptrs<T>& ptrs) {
+    // nested lists are done before the outer one is, so they can share this stack
+    auto mark = stack_.size();
+    for (auto ptr : ptrs) {
+        auto ref = flatten(ptr);
+        stack_.emplace_back(ref);
+    }
+
+    auto res = list(std::span<const Ref>(stack_.begin() + mark, stack_.end()));
+    stack_.resize(mark);
+    return res;
+}
+
+Ref Flattener::flatten(const AST* ast) {
+    if (ast == nullptr) return FlatAST::None;
+
+    auto loc = ast->loc;
+    // canonical leaves have no location of their own
+    if (ast->comp.is_leaf(ast)) {
+        assert(!parents_.empty());
+        auto& parent = parents_.back();
+        auto& comp = parent.ast->comp;
+        // the unknown of a unit tuple is located at the tuple
+        loc = comp.has_leaf_locs(parent.ast) ? comp.leaf_loc(parent.ast, parent.num_leaves++) : parent.loc;
+        if (!isa<TupExpr>(ast)) return flatten(ast, loc);
+    }
+
+    parents_.push_back({ast, loc, 0});
+    auto ref = flatten(ast, loc);
+    parents_.pop_back();
+    return ref;
+}
+
+FlatAST Flattener::finish(Span loc, std::span<const Ref> stmts) {
+    add(Node::Prg, loc, 0, list(stmts));
+    return std::move(flat_);
+}
+
+Ref Flattener::flatten(const AST* ast, Span loc) {
+    switch (ast->node()) {
+        case Node::Id: return add(Node::Id, loc, 0, as<Id>(ast)->sym.id());
+        /*
+         * Nom
+         */
+        case Node::NomNom: {
+            auto nom  = as<NomNom>(ast);
+            auto id   = flatten(nom->id);
+            auto type = flatten(nom->type);
+            auto body = flatten(nom->body());
+            return add(Node::NomNom, loc, 0, extra({id, type, body}));
+        }
+        case Node::AbsNom: {
+            auto abs   = as<AbsNom>(ast);
+            auto id    = flatten(abs->id);
+            auto doms  = list(abs->doms);
+            auto codom = flatten(abs->codom);
+            auto body  = flatten(abs->body());
+            return add(Node::AbsNom, loc, abs->tag, extra({id, doms, codom, body}));
+        }
+        case Node::SigNom: return add(Node::SigNom, loc, 0, flatten(as<SigNom>(ast)->id));
+        /*
+         * Bndr
+         */
+        case Node::ErrBndr: return add(Node::ErrBndr, loc);
+        case Node::IdBndr: {
+            auto bndr = as<IdBndr>(ast);
+            auto id   = flatten(bndr->id);
+            auto type = flatten(bndr->type);
+            return add(Node::IdBndr, loc, 0, id, type);
+        }
+        case Node::SigBndr: return add(Node::SigBndr, loc, 0, list(as<SigBndr>(ast)->elems));
+        /*
+         * Ptrn
+         */
+        case Node::ErrPtrn: return add(Node::ErrPtrn, loc);
+        case Node::IdPtrn: {
+            auto ptrn = as<IdPtrn>(ast);
+            auto id   = flatten(ptrn->id);
+            auto type = flatten(ptrn->type);
+            return add(Node::IdPtrn, loc, u8(ptrn->mut), id, type);
+        }
+        case Node::TupPtrn: {
+            auto ptrn  = as<TupPtrn>(ast);
+            auto elems = list(ptrn->elems);
+            return add(Node::TupPtrn, loc, u8(ptrn->delims), elems);
+        }
+        /*
+         * Stmt
+         */
+        case Node::AssignStmt: {
+            auto stmt = as<AssignStmt>(ast);
+            auto lhs  = flatten(stmt->lhs);
+            auto rhs  = flatten(stmt->rhs);
+            return add(Node::AssignStmt, loc, stmt->tag, lhs, rhs);
+        }
+        case Node::ExprStmt: return add(Node::ExprStmt, loc, 0, flatten(as<ExprStmt>(ast)->expr));
+        case Node::LetStmt: {
+            auto stmt = as<LetStmt>(ast);
+            auto ptrn = flatten(stmt->ptrn);
+            auto init = flatten(stmt->init);
+            return add(Node::LetStmt, loc, 0, ptrn, init);
+        }
+        case Node::NomStmt: return add(Node::NomStmt, loc, 0, flatten(as<NomStmt>(ast)->nom));
+        /*
+         * Expr
+         */
+        case Node::AbsExpr: return add(Node::AbsExpr, loc, 0, flatten(as<AbsExpr>(ast)->abs));
+        case Node::TupElem: {
+            auto elem = as<TupElem>(ast);
+            auto id   = flatten(elem->id);
+            auto expr = flatten(elem->expr);
+            return add(Node::TupElem, loc, 0, id, expr);
+        }
+        case Node::TupExpr: {
+            auto tup   = as<TupExpr>(ast);
+            auto elems = list(tup->elems);
+            auto type  = flatten(tup->type);
+            return add(Node::TupExpr, loc, u8(tup == tup->comp.unit_tup()), elems, type);
+        }
+        case Node::AppExpr: {
+            auto app    = as<AppExpr>(ast);
+            auto callee = flatten(app->callee);
+            auto arg    = flatten(app->arg);
+            return add(Node::AppExpr, loc, app->tag, callee, arg);
+        }
+        case Node::BlockExpr: {
+            auto block = as<BlockExpr>(ast);
+            auto stmts = list(block->stmts);
+            auto expr  = flatten(block->expr);
+            return add(Node::BlockExpr, loc, 0, stmts, expr);
+        }
+        case Node::BottomExpr: return add(Node::BottomExpr, loc);
+        case Node::ErrExpr:    return add(Node::ErrExpr,    loc);
+        case Node::UnkExpr:    return add(Node::UnkExpr,    loc);
+        case Node::FieldExpr: {
+            auto field = as<FieldExpr>(ast);
+            auto lhs   = flatten(field->lhs);
+            auto id    = flatten(field->id);
+            return add(Node::FieldExpr, loc, 0, lhs, id);
+        }
+        case Node::ForExpr: {
+            auto for_ = as<ForExpr>(ast);
+            auto ptrn = flatten(for_->ptrn);
+            auto expr = flatten(for_->expr);
+            auto body = flatten(for_->body);
+            return add(Node::ForExpr, loc, 0, extra({ptrn, expr, body}));
+        }
+        case Node::IdExpr:  return add(Node::IdExpr,  loc, 0, flatten(as<IdExpr >(ast)->id));
+        case Node::VarExpr: return add(Node::VarExpr, loc, 0, flatten(as<VarExpr>(ast)->id));
+        case Node::IfExpr: {
+            auto if_       = as<IfExpr>(ast);
+            auto cond      = flatten(if_->cond);
+            auto then_expr = flatten(if_->then_expr);
+            auto else_expr = flatten(if_->else_expr);
+            return add(Node::IfExpr, loc, 0, extra({cond, then_expr, else_expr}));
+        }
+        case Node::InfixExpr: {
+            auto infix = as<InfixExpr>(ast);
+            auto lhs   = flatten(infix->lhs);
+            auto rhs   = flatten(infix->rhs);
+            return add(Node::InfixExpr, loc, infix->tag, lhs, rhs);
+        }
+        case Node::LitExpr: {
+            auto lit = as<LitExpr>(ast);
+            u64 u = lit->tag == Tok::Tag::L_f ? std::bit_cast<u64>(lit->f())
+                  : lit->tag == Tok::Tag::L_s ? std::bit_cast<u64>(lit->s())
+                  :                             lit->u();
+            return add(Node::LitExpr, loc, lit->tag, u32(u), u32(u >> 32_u64));
+        }
+        case Node::PkExpr: {
+            auto pk   = as<PkExpr>(ast);
+            auto dims = list(pk->dims);
+            auto body = flatten(pk->body);
+            return add(Node::PkExpr, loc, 0, dims, body);
+        }
+        case Node::ArExpr: {
+            auto ar   = as<ArExpr>(ast);
+            auto dims = list(ar->dims);
+            auto body = flatten(ar->body);
+            return add(Node::ArExpr, loc, 0, dims, body);
+        }
+        case Node::PiExpr: {
+            auto pi    = as<PiExpr>(ast);
+            auto doms  = list(pi->doms);
+            auto codom = flatten(pi->codom);
+            return add(Node::PiExpr, loc, pi->tag, doms, codom);
+        }
+        case Node::PrefixExpr: {
+            auto prefix = as<PrefixExpr>(ast);
+            return add(Node::PrefixExpr, loc, prefix->tag, flatten(prefix->rhs));
+        }
+        case Node::PostfixExpr: {
+            auto postfix = as<PostfixExpr>(ast);
+            return add(Node::PostfixExpr, loc, postfix->tag, flatten(postfix->lhs));
+        }
+        case Node::KeyExpr: return add(Node::KeyExpr, loc, as<KeyExpr>(ast)->tag);
+        case Node::SigExpr: return add(Node::SigExpr, loc, 0, list(as<SigExpr>(ast)->elems));
+        case Node::WhileExpr: {
+            auto while_ = as<WhileExpr>(ast);
+            auto cond   = flatten(while_->cond);
+            auto body   = flatten(while_->body);
+            return add(Node::WhileExpr, loc, 0, cond, body);
+        }
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+FlatAST flatten(const Prg* prg) {
+    Flattener flattener;
+    std::vector<Ref> stmts;
+    for (auto stmt : prg->stmts) stmts.emplace_back(flattener.flatten(stmt));
+    return flattener.finish(prg->loc, stmts);
+}
+
+/*
+ * unflatten
+ */
+
+class Unflattener {
+public:
+    Unflattener(Comp& comp, const FlatAST& flat)
+        : comp(comp)
+        , flat(flat)
+    {}
+
+    const AST* unflatten(Ref);
+    const AST* node(Ref);
+
+    template<class T>
+    Ptr<T> get(Ref ref) { return ref == FlatAST::None ? nullptr : static_cast<Ptr<T>>(unflatten(ref)); }
+    template<class T>
+    Ptr<T> get_extra(Ref ref, u32 i) { return get<T>(flat.extra(flat.lhs(ref) + i)); }
+    template<class T>
+    Ptrs<T> list(u32 list) {
+        PtrsBuilder<T> builder;
+        for (auto ref : flat.list(list)) builder.emplace_back(get<T>(ref));
+        return comp.mk_ptrs(builder);
+    }
+
+    Comp& comp;
+    const FlatAST& flat;
+
+private:
+    std::vector<std::pair<Ref, Span>> leaves_; ///< canonical leaf children of the nodes being made
+};
+
+const AST* Unflattener::unflatten(Ref ref) {
+    auto node = flat.node(ref);
+    if (node == Node::KeyExpr || node == Node::LitExpr || node == Node::UnkExpr
+        || (node == Node::TupExpr && flat.aux(ref))) {
+        leaves_.emplace_back(ref, flat.loc(ref));
+        return this->node(ref);
+    }
+
+    auto mark = leaves_.size();
+    auto ast = this->node(ref);
+    if (leaves_.size() != mark) {
+        // children are made in unspecified order but precede their parent in constructor argument order
+        std::sort(leaves_.begin() + mark, leaves_.end(), [](auto a, auto b) { return a.first < b.first; });
+        std::vector<Span> locs;
+        for (auto i = leaves_.begin() + mark, e = leaves_.end(); i != e; ++i) locs.emplace_back(i->second);
+        comp.set_leaf_locs(ast, locs);
+        leaves_.resize(mark);
+    }
+    return ast;
+}
+
+const AST* Unflattener::node(Ref ref) {
+    auto loc = flat.loc(ref);
+    auto lhs = flat.lhs(ref);
+    auto rhs = flat.rhs(ref);
+    auto tag = flat.tag(ref);
+
+    switch (flat.node(ref)) {
+        case Node::Id:          return comp.mk<Id>(loc, comp.syms().sym(lhs));
+        case Node::Prg:         return comp.mk<Prg>(loc, list<Stmt>(lhs));
+        case Node::NomNom:      return comp.mk<NomNom>(loc, get_extra<Id>(ref, 0), get_extra<Expr>(ref, 1), get_extra<Expr>(ref, 2));
+        case Node::AbsNom:      return comp.mk<AbsNom>(loc, tag, get_extra<Id>(ref, 0), list<Ptrn>(flat.extra(lhs + 1)),
+                                                       get_extra<Expr>(ref, 2), get_extra<Expr>(ref, 3));
+        case Node::ErrBndr:     return comp.mk<ErrBndr>(loc);
+        case Node::IdBndr:      return comp.mk<IdBndr>(loc, get<Id>(lhs), get<Expr>(rhs));
+        case Node::SigBndr:     return comp.mk<SigBndr>(loc, list<Bndr>(lhs));
+        case Node::ErrPtrn:     return comp.mk<ErrPtrn>(loc);
+        case Node::IdPtrn:      return comp.mk<IdPtrn>(loc, bool(flat.aux(ref)), get<Id>(lhs), get<Expr>(rhs));
+        case Node::TupPtrn:     return comp.mk<TupPtrn>(loc, list<Ptrn>(lhs), bool(flat.aux(ref)));
+        case Node::AssignStmt:  return comp.mk<AssignStmt>(loc, get<Expr>(lhs), tag, get<Expr>(rhs));
+        case Node::ExprStmt:    return comp.mk<ExprStmt>(loc, get<Expr>(lhs));
+        case Node::LetStmt:     return comp.mk<LetStmt>(loc, get<Ptrn>(lhs), get<Expr>(rhs));
+        case Node::NomStmt:     return comp.mk<NomStmt>(loc, get<Nom>(lhs));
+        case Node::AbsExpr:     return comp.mk<AbsExpr>(loc, get<AbsNom>(lhs));
+        case Node::TupElem:     return comp.mk<TupElem>(loc, get<Id>(lhs), get<Expr>(rhs));
+        case Node::TupExpr:
+            if (flat.aux(ref)) return comp.unit_tup();
+            return comp.mk<TupExpr>(loc, list<TupElem>(lhs), get<Expr>(rhs));
+        case Node::AppExpr:     return comp.mk<AppExpr>(loc, tag, get<Expr>(lhs), get<TupExpr>(rhs));
+        case Node::BlockExpr:   return comp.mk<BlockExpr>(loc, list<Stmt>(lhs), get<Expr>(rhs));
+        case Node::BottomExpr:  return comp.mk<BottomExpr>(loc);
+        case Node::ErrExpr:     return comp.mk<ErrExpr>(loc);
+        case Node::UnkExpr:     return comp.unk_expr();
+        case Node::FieldExpr:   return comp.mk<FieldExpr>(loc, get<Expr>(lhs), get<Id>(rhs));
+        case Node::ForExpr:     return comp.mk<ForExpr>(loc, get_extra<Ptrn>(ref, 0), get_extra<Expr>(ref, 1), get_extra<BlockExpr>(ref, 2));
+        case Node::IdExpr:      return comp.mk<IdExpr>(get<Id>(lhs));
+        case Node::VarExpr:     return comp.mk<VarExpr>(loc, get<Id>(lhs));
+        case Node::IfExpr:      return comp.mk<IfExpr>(loc, get_extra<Expr>(ref, 0), get_extra<Expr>(ref, 1), get_extra<Expr>(ref, 2));
+        case Node::InfixExpr:   return comp.mk<InfixExpr>(loc, get<Expr>(lhs), tag, get<Expr>(rhs));
+        case Node::LitExpr: {
+            auto u = u64(lhs) | u64(rhs) << 32_u64;
+            switch (tag) {
+                case Tok::Tag::L_f: return comp.lit_expr(Tok(loc, std::bit_cast<f64>(u)));
+                case Tok::Tag::L_s: return comp.lit_expr(Tok(loc, std::bit_cast<s64>(u)));
+                case Tok::Tag::L_u: return comp.lit_expr(Tok(loc, u));
+                default: THORIN_UNREACHABLE;
+            }
+        }
+        case Node::PkExpr:      return comp.mk<PkExpr>(loc, list<Bndr>(lhs), get<Expr>(rhs));
+        case Node::ArExpr:      return comp.mk<ArExpr>(loc, list<Bndr>(lhs), get<Expr>(rhs));
+        case Node::PiExpr:      return comp.mk<PiExpr>(loc, tag, list<Bndr>(lhs), get<Expr>(rhs));
+        case Node::PrefixExpr:  return comp.mk<PrefixExpr>(loc, tag, get<Expr>(lhs));
+        case Node::PostfixExpr: return comp.mk<PostfixExpr>(loc, get<Expr>(lhs), tag);
+        case Node::KeyExpr:     return comp.key_expr(tag);
+        case Node::SigExpr:     return comp.mk<SigExpr>(loc, list<Bndr>(lhs));
+        case Node::WhileExpr:   return comp.mk<WhileExpr>(loc, get<Expr>(lhs), get<BlockExpr>(rhs));
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+Ptr<Prg> unflatten(Comp& comp, const FlatAST& flat) {
+    return as<Prg>(Unflattener(comp, flat).unflatten(flat.root()));
+}
+
+/*
+ * bind
+ */
+
+/// Mirrors Scopes and the Binder in bind.cpp.
+class FlatScopes {
+public:
+    FlatScopes(Comp& comp, const FlatAST& flat)
+        : comp(comp)
+        , flat(flat)
+        , decls(flat.size(), FlatAST::None)
+    {}
+
+    void bind(Ref);
+    void infiltrate(Ref);
+    void bind_list(u32 list) { for (auto ref : flat.list(list)) bind(ref); }
+    void bind_stmts(u32 list);
+    void insert(Ref decl);
+    void use(Ref use);
+    std::optional<Ref> find(Sym);
+    Sym sym(Ref id) const { return comp.syms().sym(flat.lhs(id)); }
+
+    Comp& comp;
+    const FlatAST& flat;
+    std::vector<Ref> decls;
+
+private:
+    std::vector<SymMap<Ref>> scopes_; ///< FlatAST::None marks an undeclared identifier that has already been reported
+};
+
+std::optional<Ref> FlatScopes::find(Sym sym) {
+    for (auto i = scopes_.rbegin(); i != scopes_.rend(); ++i) {
+        if (auto decl = i->lookup(sym)) return decl;
+    }
+    return {};
+}
+
+void FlatScopes::insert(Ref decl) {
+    assert(!scopes_.empty());
+
+    auto id = flat.decl_id(decl);
+    auto sym = this->sym(id);
+    if (comp.is_anonymous(sym)) return;
+
+    if (auto&& [i, succ] = scopes_.back().emplace(sym, decl); !succ) {
+        if (i->second != FlatAST::None) {
+            comp.err(flat.loc(id), "redefinition of '{}'", sym);
+            comp.note(flat.loc(flat.decl_id(i->second)), "previous declaration of '{}' was here", sym);
+        } else {
+            i->second = decl; // now we have a valid definition
+        }
+    }
+}
+
+void FlatScopes::use(Ref use) {
+    auto id = flat.lhs(use);
+    auto sym = this->sym(id);
+    if (comp.is_anonymous(sym)) {
+        comp.err(flat.loc(id), "identifier '_' is reserved for anonymous declarations");
+    } else {
+        auto decl = find(sym);
+        if (decl) {
+            decls[use] = *decl;
+        } else {
+            comp.err(flat.loc(id), "use of undeclared identifier '{}'", sym);
+            // put into scope so we don't see the same error over and over again
+            scopes_.back().emplace(sym, FlatAST::None);
+        }
+    }
+}
+
+void FlatScopes::bind_stmts(u32 list) {
+    auto stmts = flat.list(list);
+    auto is_nom_stmt = [&](Ref ref) { return flat.node(ref) == Node::NomStmt; };
+
+    for (auto i = stmts.begin(), e = stmts.end(); i != e;) {
+        if (is_nom_stmt(*i)) {
+            for (auto j = i; j != e && is_nom_stmt(*j); ++j)
+                insert(flat.lhs(*j));
+            for (; i != e && is_nom_stmt(*i); ++i)
+                bind(flat.lhs(*i));
+        } else {
+            bind(*i);
+            ++i;
+        }
+    }
+}
+
+void FlatScopes::infiltrate(Ref ref) {
+    switch (flat.node(ref)) {
+        case Node::ErrBndr: return;
+        case Node::IdBndr:
+            bind(flat.rhs(ref));
+            insert(ref);
+            return;
+        case Node::SigBndr:
+            for (auto elem : flat.list(flat.lhs(ref))) infiltrate(elem);
+            return;
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+void FlatScopes::bind(Ref ref) {
+    if (ref == FlatAST::None) return;
+    auto lhs = flat.lhs(ref);
+    auto rhs = flat.rhs(ref);
+
+    switch (flat.node(ref)) {
+        case Node::Prg:
+            scopes_.emplace_back();
+            bind_stmts(lhs);
+            scopes_.pop_back();
+            return;
+        case Node::NomNom:
+            bind(flat.extra(lhs + 1));
+            bind(flat.extra(lhs + 2));
+            return;
+        case Node::AbsNom:
+            scopes_.emplace_back();
+            insert(ref);
+            bind_list(flat.extra(lhs + 1));
+            bind(flat.extra(lhs + 2));
+            bind(flat.extra(lhs + 3));
+            scopes_.pop_back();
+            return;
+        case Node::ErrBndr:
+        case Node::IdBndr:
+        case Node::SigBndr:
+            scopes_.emplace_back();
+            infiltrate(ref);
+            scopes_.pop_back();
+            return;
+        case Node::ErrPtrn:
+        case Node::BottomExpr:
+        case Node::ErrExpr:
+        case Node::KeyExpr:
+        case Node::LitExpr:
+        case Node::UnkExpr:
+            return;
+        case Node::IdPtrn:
+            bind(rhs);
+            insert(ref);
+            return;
+        case Node::TupPtrn:
+            bind_list(lhs);
+            return;
+        case Node::TupExpr:
+        case Node::PkExpr:
+        case Node::ArExpr:
+            bind_list(lhs);
+            bind(rhs);
+            return;
+        case Node::IdExpr:
+        case Node::VarExpr:
+            use(ref);
+            return;
+        case Node::AbsExpr:
+        case Node::FieldExpr:
+        case Node::PostfixExpr:
+        case Node::PrefixExpr:
+        case Node::ExprStmt:
+        case Node::NomStmt:
+            bind(lhs);
+            return;
+        case Node::TupElem:
+            bind(rhs);
+            return;
+        case Node::AppExpr:
+        case Node::InfixExpr:
+        case Node::WhileExpr:
+        case Node::AssignStmt:
+            bind(lhs);
+            bind(rhs);
+            return;
+        case Node::BlockExpr:
+            scopes_.emplace_back();
+            bind_stmts(lhs);
+            bind(rhs);
+            scopes_.pop_back();
+            return;
+        case Node::PiExpr:
+            scopes_.emplace_back();
+            for (auto dom : flat.list(lhs)) infiltrate(dom);
+            bind(rhs);
+            scopes_.pop_back();
+            return;
+        case Node::SigExpr:
+            scopes_.emplace_back();
+            for (auto elem : flat.list(lhs)) infiltrate(elem);
+            scopes_.pop_back();
+            return;
+        case Node::ForExpr:
+            bind(flat.extra(lhs + 0));
+            bind(flat.extra(lhs + 2));
+            return;
+        case Node::IfExpr:
+            bind(flat.extra(lhs + 0));
+            bind(flat.extra(lhs + 1));
+            bind(flat.extra(lhs + 2));
+            return;
+        case Node::LetStmt:
+            bind(rhs);
+            bind(lhs);
+            return;
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+std::vector<Ref> bind(Comp& comp, const FlatAST& flat) {
+    FlatScopes scopes(comp, flat);
+    scopes.bind(flat.root());
+    return std::move(scopes.decls);
+}
+
+/*
+ * emit
+ */
+
+/// Mirrors the Emitter in emit.cpp.
+class FlatEmitter {
+public:
+    FlatEmitter(Emitter& emitter, const FlatAST& flat, const std::vector<Ref>& decls)
+        : emitter(emitter)
+        , flat(flat)
+        , decls(decls)
+        , defs(flat.size(), nullptr)
+    {}
+
+    thorin::World& world() { return emitter.world(); }
+    const thorin::Def* dbg(Ref ref) { return emitter.dbg(flat.loc(ref)); }
+    void emit_stmts(u32 list);
+    void emit_nom(Ref);
+    void emit(Ref ptrn, const thorin::Def*);
+    const thorin::Def* emit(Ref);
+
+    Emitter& emitter;
+    const FlatAST& flat;
+    const std::vector<Ref>& decls;
+    std::vector<const thorin::Def*> defs; ///< of the declaring nodes
+};
+
+void FlatEmitter::emit_stmts(u32 list) {
+    auto stmts = flat.list(list);
+    auto is_nom_stmt = [&](Ref ref) { return flat.node(ref) == Node::NomStmt; };
+
+    for (auto i = stmts.begin(), e = stmts.end(); i != e;) {
+        if (is_nom_stmt(*i)) {
+            for (auto j = i; j != e && is_nom_stmt(*j); ++j)
+                emit_nom(flat.lhs(*j));
+            for (; i != e && is_nom_stmt(*i); ++i) {}
+        } else {
+            emit(*i);
+            ++i;
+        }
+    }
+}
+
+void FlatEmitter::emit_nom(Ref ref) {
+    if (flat.node(ref) != Node::AbsNom) return;
+
+    // dump the doms via the tree printer
+    auto& comp = emitter.comp;
+    for (auto dom : flat.list(flat.extra(flat.lhs(ref) + 1))) {
+        auto mark = comp.mark();
+        Unflattener(comp, flat).unflatten(dom)->dump();
+        comp.rewind(mark);
+    }
+}
+
+void FlatEmitter::emit(Ref ref, const thorin::Def* def) {
+    switch (flat.node(ref)) {
+        case Node::IdPtrn: defs[ref] = def; return;
+        case Node::TupPtrn: {
+            auto elems = flat.list(flat.lhs(ref));
+            size_t n = elems.size();
+            for (size_t i = 0; i != n; ++i)
+                emit(elems[i], world().extract(def, n, i, dbg(elems[i])));
+            return;
+        }
+        case Node::ErrPtrn: return;
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+const thorin::Def* FlatEmitter::emit(Ref ref) {
+    auto lhs = flat.lhs(ref);
+    auto rhs = flat.rhs(ref);
+
+    switch (flat.node(ref)) {
+        case Node::Prg:
+            emit_stmts(lhs);
+            return nullptr;
+        /*
+         * Stmt
+         */
+        case Node::ExprStmt:
+            emit(lhs);
+            return nullptr;
+        case Node::AssignStmt:
+            emit(lhs);
+            emit(rhs);
+            return nullptr;
+        case Node::LetStmt: {
+            auto i = rhs != FlatAST::None ? emit(rhs) : world().bot(world().type());
+            i->dump(0);
+            emit(lhs, i);
+            return nullptr;
+        }
+        /*
+         * Expr
+         */
+        case Node::UnkExpr: return world().nom_unk(dbg(ref));
+        case Node::AbsExpr: return defs[lhs];
+        case Node::AppExpr: {
+            auto c = emit(lhs);
+            auto a = emit(rhs);
+            return world().app(c, a, dbg(ref));
+        }
+        case Node::ArExpr:
+        case Node::PkExpr:
+        case Node::PiExpr:
+            if (rhs != FlatAST::None) emit(rhs);
+            return nullptr;
+        case Node::BlockExpr:
+            emit_stmts(lhs);
+            return emit(rhs);
+        case Node::ErrExpr: return world().bot(world().type());
+        case Node::FieldExpr:
+        case Node::PrefixExpr:
+        case Node::PostfixExpr:
+            emit(lhs);
+            return nullptr;
+        case Node::IdExpr: return decls[ref] != FlatAST::None ? defs[decls[ref]] : nullptr;
+        case Node::IfExpr:
+            emit(flat.extra(lhs + 0));
+            emit(flat.extra(lhs + 1));
+            emit(flat.extra(lhs + 2));
+            return nullptr;
+        case Node::InfixExpr:
+            emit(lhs);
+            emit(rhs);
+            return nullptr;
+        case Node::TupElem: return emit(rhs);
+        case Node::TupExpr: {
+            auto elems = flat.list(lhs);
+            DefArray args(elems.size(), [&](size_t i) { return emit(elems[i]); });
+            auto t = emit(rhs);
+            return world().tuple(t, args, dbg(ref));
+        }
+        case Node::KeyExpr:
+            switch (flat.tag(ref)) {
+                case Tok::Tag::K_Type: return world().type();
+                case Tok::Tag::K_Kind: return world().kind();
+                case Tok::Tag::K_Nat:  return world().type_nat();
+                default: THORIN_UNREACHABLE;
+            }
+        case Node::BottomExpr:
+        case Node::ForExpr:
+        case Node::LitExpr:
+        case Node::MatchExpr:
+        case Node::SigExpr:
+        case Node::VarExpr:
+        case Node::WhileExpr:
+            return nullptr;
+        default: THORIN_UNREACHABLE;
+    }
+}
+
+std::vector<const thorin::Def*> emit(Emitter& emitter, const FlatAST& flat, const std::vector<Ref>& decls) {
+    FlatEmitter flat_emitter(emitter, flat, decls);
+    flat_emitter.emit(flat.root());
+    return std::move(flat_emitter.defs);
+}
+
+}
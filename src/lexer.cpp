@@ -1,6 +1,17 @@
 #include "dimpl/lexer.h"
 
+#include "dimpl/parallel.h"
+#include "dimpl/scan.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
 #include <stdexcept>
+#include <utility>
 
 namespace dimpl {
 
@@ -14,95 +25,250 @@ inline bool oct(uint32_t c) { return '0' <= c && c <= '7'; }
 inline bool eE (uint32_t c) { return c == 'e' || c == 'E'; }
 inline bool sgn(uint32_t c) { return c == '+' || c == '-'; }
 
-Lexer::Lexer(Comp& comp, std::istream& is, const char* filename)
-    : comp_(comp)
-    , stream_(is)
-{
-    size_t i = 0;
-#define CODE(tag, str) keys_[i++] = {Tok::Tag::tag, comp.sym(str)};
+/*
+ * keywords
+ */
+
+namespace {
+
+/// Keywords are recognized by a perfect hash over length, first, second, and last byte - generated from @c DIMPL_KEY.
+struct Key {
+    std::string_view str;
+    Tok::Tag tag = Tok::Tag::M_id;
+};
+
+constexpr std::array<Key, Num_Keys> keys = {{
+#define CODE(t, str) {str, Tok::Tag::t},
     DIMPL_KEY(CODE)
 #undef CODE
+}};
 
-    if (!stream_) throw std::runtime_error("stream is bad");
-    next();
-    loc_ = {filename, {1, 1}, {1, 1}};
-    peek_pos_ = {1, 1};
-    accept(0xfeff, false); // eat utf-8 BOM if present
+constexpr size_t Key_Min = std::ranges::min(keys, {}, [](auto k) { return k.str.size(); }).str.size();
+constexpr size_t Key_Max = std::ranges::max(keys, {}, [](auto k) { return k.str.size(); }).str.size();
+constexpr uint32_t Key_Bits = 6;
+static_assert(Key_Min >= 2 && (1_u32 << Key_Bits) >= 2 * Num_Keys);
+
+constexpr uint32_t key_hash(std::string_view s, uint32_t seed) {
+    auto b = [&](size_t i) { return uint32_t(uint8_t(s[i])); };
+    uint32_t x = uint32_t(s.size()) | b(0) << 8_u32 | b(1) << 16_u32 | b(s.size() - 1) << 24_u32;
+    return (x * seed) >> (32_u32 - Key_Bits);
 }
 
-inline bool is_bit_set(uint32_t val, uint32_t n) { return bool((val >> n) & 1_u32); }
-inline bool is_bit_clear(uint32_t val, uint32_t n) { return !is_bit_set(val, n); }
+constexpr uint32_t find_key_seed() {
+    for (uint32_t seed = 0x9e3779b1_u32; true; seed += 2) {
+        std::array<bool, 1 << Key_Bits> used = {};
+        bool ok = true;
+        for (auto&& key : keys) {
+            auto h = key_hash(key.str, seed);
+            if (used[h]) { ok = false; break; }
+            used[h] = true;
+        }
+        if (ok) return seed;
+    }
+}
 
-// see https://en.wikipedia.org/wiki/UTF-8
-uint32_t Lexer::next() {
-    uint32_t result = peek_;
-    uint32_t b1 = stream_.get();
-    std::fill(peek_bytes_, peek_bytes_ + 4, 0);
-    peek_bytes_[0] = b1;
+constexpr uint32_t Key_Seed = find_key_seed();
 
-    if (b1 == (uint32_t) std::istream::traits_type::eof()) {
-        loc_.finis = peek_pos_;
-        peek_ = b1;
-        return result;
+constexpr auto key_table = [] {
+    std::array<Key, 1 << Key_Bits> table = {};
+    for (auto&& key : keys) table[key_hash(key.str, Key_Seed)] = key;
+    return table;
+}();
+
+/// Yields the keyword's Tok::Tag or Tok::Tag::M_id.
+Tok::Tag classify(std::string_view s) {
+    if (s.size() < Key_Min || s.size() > Key_Max) return Tok::Tag::M_id;
+    auto& key = key_table[key_hash(s, Key_Seed)];
+    return key.str == s ? key.tag : Tok::Tag::M_id;
+}
+
+/*
+ * fixed tokens
+ */
+
+/// Spelling of a token that is fully described by its Tok::Tag.
+struct Fix {
+    std::string_view str;
+    Tok::Tag tag;
+};
+
+constexpr auto fixes = std::to_array<Fix>({
+#define CODE(t, str) {str, Tok::Tag::t},
+    DIMPL_TOK(CODE)
+#undef CODE
+#define CODE(t, str, name) {str, Tok::Tag::t},
+    DIMPL_ASSIGN(CODE)
+#undef CODE
+#define CODE(t, str, prec, name) {str, Tok::Tag::t},
+    DIMPL_OP(CODE)
+#undef CODE
+    // ASCII aliases
+    {"\\",  Tok::Tag::B_lam},
+    {"\\/", Tok::Tag::B_forall},
+    {"->",  Tok::Tag::P_arrow},
+});
+
+constexpr bool is_fix(const Fix& fix) { return fix.tag != Tok::Tag::M_eof && fix.tag != Tok::Tag::M_id; }
+
+/// Each byte that occurs in a Fix gets its own class; all other bytes share class 0 that never has a transition.
+constexpr auto byte2cls = [] {
+    std::array<uint8_t, 256> cls = {};
+    uint8_t n = 1;
+    for (auto&& fix : fixes) {
+        if (!is_fix(fix)) continue;
+        for (auto c : fix.str) {
+            if (cls[uint8_t(c)] == 0) cls[uint8_t(c)] = n++;
+        }
+    }
+    return cls;
+}();
+
+constexpr size_t Num_Cls = size_t(std::ranges::max(byte2cls)) + 1;
+
+/**
+ * Trie over the bytes of all Fix%es - generated from @c DIMPL_TOK, @c DIMPL_OP, @c DIMPL_ASSIGN and the aliases above.
+ * State 0 is dead, state 1 is the start state, and @c delta[1] is the dispatch table on the first byte.
+ * A state accepts if its @c tag is not Tok::Tag::M_id.
+ */
+template<size_t N>
+struct DFA {
+    std::array<std::array<uint8_t, Num_Cls>, N> delta = {};
+    std::array<Tok::Tag, N> tags = {};
+    size_t size = 2;
+};
+
+template<size_t N>
+constexpr DFA<N> build_dfa() {
+    DFA<N> dfa;
+    dfa.tags.fill(Tok::Tag::M_id);
+    for (auto&& fix : fixes) {
+        if (!is_fix(fix)) continue;
+        size_t s = 1;
+        for (auto c : fix.str) {
+            auto& next = dfa.delta[s][byte2cls[uint8_t(c)]];
+            if (next == 0) next = uint8_t(dfa.size++);
+            s = next;
+        }
+        assert(dfa.tags[s] == Tok::Tag::M_id && "two tokens with the same spelling");
+        dfa.tags[s] = fix.tag;
     }
+    return dfa;
+}
 
-    int n_bytes = 1;
-    auto get_next_utf8_byte = [&] () {
-        uint32_t b = stream_.get();
-        peek_bytes_[n_bytes++] = b;
-        if (is_bit_clear(b, 7) || is_bit_set(b, 6))
-            comp().err(loc_, "invalid utf-8 character");
-        return b & 0b00111111_u32;
-    };
+constexpr size_t Num_States = build_dfa<256>().size;
+constexpr auto dfa = build_dfa<Num_States>();
+
+/// Longest Fix that is a prefix of <tt>[p, end)</tt>; yields Tok::Tag::M_id if there is none.
+std::pair<Tok::Tag, const char*> match_fix(const char* p, const char* end) {
+    auto tag = Tok::Tag::M_id;
+    auto to = p;
+    for (size_t s = 1; p != end;) {
+        s = dfa.delta[s][byte2cls[uint8_t(*p++)]];
+        if (s == 0) break;
+        if (dfa.tags[s] != Tok::Tag::M_id) {
+            tag = dfa.tags[s];
+            to = p;
+        }
+    }
+    return {tag, to};
+}
 
-    auto update_peek = [&] (uint32_t peek) {
-        loc_.finis = peek_pos_;
-        ++peek_pos_.col;
-        peek_ = peek;
-        return result;
-    };
+}
+
+Lexer::Lexer(Comp& comp, Source&& src)
+    : comp_(comp)
+    , max_errors_(comp.max_errors)
+{
+    auto& file = comp.srcs().add(std::move(src));
+    init(file, 0, file.src.text().size());
+}
+
+Lexer::Lexer(Comp& comp, const SourceManager::File& file, size_t begin, size_t end, bool in_comment, int max_errors)
+    : comp_(comp)
+    , max_errors_(max_errors)
+    , chunk_(true)
+{
+    init(file, begin, end);
+    if (in_comment) {
+        tok_ptr_ = nullptr; // the comment began before this chunk
+        eat_comments();
+    }
+}
+
+void Lexer::init(const SourceManager::File& file, size_t begin, size_t end) {
+    auto text = file.src.text();
+    base_ = file.base;
+    begin_ = text.data();
+    ptr_ = peek_ptr_ = tok_ptr_ = begin_ + begin;
+    end_ = begin_ + end;
+
+    // validate once up front so next() never has to
+    if (auto bad = scan::validate_utf8(ptr_, end_); bad != end_) {
+        comp().err(span(bad, bad), "invalid utf-8 sequence at byte offset {}", bad - begin_);
+        end_ = bad; // only lex the valid prefix
+        valid_ = false;
+    }
 
-    if (is_bit_clear(b1, 7)) {
-        // 1-byte: 0xxxxxxx
-        loc_.finis = peek_pos_;
+    next();
+    if (begin == 0) accept("\ufeff"); // eat utf-8 BOM if present
+}
 
-        if (b1 == '\n') {
-            ++peek_pos_.row;
-            peek_pos_.col = 0;
-        } else
-            ++peek_pos_.col;
-        peek_ = b1;
+Lexer::Lexer(Comp& comp, std::string_view text, const char* filename)
+    : Lexer(comp, Source(std::string(text), filename))
+{}
+
+static std::string read(std::istream& is) {
+    if (!is) throw std::runtime_error("stream is bad");
+    return {std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+}
+
+Lexer::Lexer(Comp& comp, std::istream& is, const char* filename)
+    : Lexer(comp, Source(read(is), filename))
+{}
+
+void Lexer::give_up() {
+    comp().note(span(peek_ptr_, peek_ptr_), "too many errors; giving up");
+    ptr_ = end_ = peek_ptr_;
+    next();
+    valid_ = false;
+}
+
+uint32_t Lexer::next() {
+    uint32_t result = peek_;
+    peek_ptr_ = ptr_;
+
+    if (ptr_ == end_) {
+        peek_ = uint32_t(std::char_traits<char>::eof());
         return result;
-    } else {
-        if (is_bit_set(b1, 6)) {
-            if (is_bit_clear(b1, 5)) {
-                // 2-bytes: 110xxxxx 10xxxxxx
-                uint32_t b2 = get_next_utf8_byte();
-                return update_peek((b1 & 0b00011111_u32) << 6_u32 | b2);
-            } else if (is_bit_clear(b1, 4)) {
-                // 3 bytes: 1110xxxx 10xxxxxx 10xxxxxx
-                uint32_t b2 = get_next_utf8_byte();
-                uint32_t b3 = get_next_utf8_byte();
-                return update_peek((b1 & 0b00001111_u32) << 12_u32 | b2 << 6_u32 | b3);
-            } else if (is_bit_clear(b1, 3)) {
-                // 4 bytes: 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-                uint32_t b2 = get_next_utf8_byte();
-                uint32_t b3 = get_next_utf8_byte();
-                uint32_t b4 = get_next_utf8_byte();
-                return update_peek((b1 & 0b00000111_u32) << 18_u32 | b2 << 12_u32 | b3 << 6_u32 | b4);
-            }
-        }
     }
 
-    comp().err(loc_, "invalid utf-8 character");
-    return 0;
+    uint32_t b = (unsigned char) *ptr_;
+    if (b < 0x80) [[likely]]
+        ++ptr_;
+    else
+        ptr_ += std::countl_one(uint8_t(b)); // the input is valid utf-8: the number of leading ones is the length
+
+    peek_ = b;
+    return result;
+}
+
+void Lexer::skip_to(const char* to) {
+    if (to == peek_ptr_) return;
+    assert(peek_ptr_ < to && to <= end_);
+    ptr_ = to;
+    next();
 }
 
 void Lexer::eat_comments() {
     while (true) {
-        while (!eof() && peek() != '*') next();
+        skip_to(scan::find(peek_ptr_, end_, '*'));
         if (eof()) {
-            comp().err(loc_, "non-terminated multiline comment");
+            if (chunk_) {
+                ends_in_comment_ = true;
+                if (tok_ptr_) comment_begin_ = span().begin;
+            } else {
+                comp().err(span(tok_ptr_, peek_ptr_), "non-terminated multiline comment");
+            }
             return;
         }
         next();
@@ -112,129 +278,58 @@ void Lexer::eat_comments() {
 
 Tok Lexer::lex() {
     while (true) {
-        str_ = "";
-        loc_.begin = peek_pos_;
+        tok_ptr_ = peek_ptr_;
 
         // end of file
-        if (eof()) {
-            str_ = "<eof>";
-            return tok(Tok::Tag::M_eof);
-        }
+        if (eof()) return tok(Tok::Tag::M_eof);
 
         // skip whitespace
-        if (accept_if(wsp, false)) {
-            while (accept_if(wsp, false)) {}
+        if (wsp(peek())) {
+            skip_to(scan::skip_wsp(ptr_, end_));
             continue;
         }
 
-        // delimiters
-        if (accept( '(')) return tok(Tok::Tag::D_paren_l);
-        if (accept( ')')) return tok(Tok::Tag::D_paren_r);
-        if (accept( '[')) return tok(Tok::Tag::D_bracket_l);
-        if (accept( ']')) return tok(Tok::Tag::D_bracket_r);
-        if (accept( '{')) return tok(Tok::Tag::D_brace_l);
-        if (accept( '}')) return tok(Tok::Tag::D_brace_r);
-        if (accept(U'«')) return tok(Tok::Tag::D_quote_l);
-        if (accept(U'»')) return tok(Tok::Tag::D_quote_r);
-        if (accept(U'‹')) return tok(Tok::Tag::D_angle_l);
-        if (accept(U'›')) return tok(Tok::Tag::D_angle_r);
-
-        // punctation
-        if (accept(U'→')) return tok(Tok::Tag::P_arrow); // "->" below
-        if (accept( '.')) return tok(Tok::Tag::P_dot);
-        if (accept( ',')) return tok(Tok::Tag::P_comma);
-        if (accept( ';')) return tok(Tok::Tag::P_semicolon);
-        if (accept( ':')) {
-            if (accept(':')) return tok(Tok::Tag::P_colon_colon);
-            return tok(Tok::Tag::P_colon);
+        // comments
+        if (peek() == '/' && ptr_ != end_ && (*ptr_ == '*' || *ptr_ == '/')) {
+            next();
+            if (accept('*'))
+                eat_comments();
+            else
+                skip_to(scan::find(peek_ptr_, end_, '\n'));
+            continue;
         }
 
-        // binder
-        if (accept(U'λ')) return tok(Tok::Tag::B_lam);
-        if (accept(U'∀')) return tok(Tok::Tag::B_forall);
-        if (accept('\\')) {
-            if (accept('/')) return tok(Tok::Tag::B_forall);
-            return tok(Tok::Tag::B_lam);
+        // delimiters, punctation, binders, operators, and assignments
+        if (auto [tag, to] = match_fix(peek_ptr_, end_); tag != Tok::Tag::M_id) {
+            skip_to(to);
+            return tok(tag);
         }
 
-        // operators/assignments
-        if (accept('=')) {
-            if (accept('=')) return tok(Tok::Tag::O_eq);
-            return tok(Tok::Tag::A_assign);
-        } else if (accept('<')) {
-            if (accept('<')) {
-                if (accept('=')) return tok(Tok::Tag::A_shl_assign);
-                return tok(Tok::Tag::O_shl);
-            }
-            if (accept('=')) return tok(Tok::Tag::O_le);
-            return tok(Tok::Tag::O_lt);
-        } else if (accept('>')) {
-            if (accept('>')) {
-                if (accept('=')) return tok(Tok::Tag::A_shr_assign);
-                return tok(Tok::Tag::O_shr);
-            }
-            if (accept('=')) return tok(Tok::Tag::O_ge);
-            return tok(Tok::Tag::O_gt);
-        } else if (accept('+')) {
-            if (accept('+')) return tok(Tok::Tag::O_inc);
-            if (accept('=')) return tok(Tok::Tag::A_add_assign);
-            return tok(Tok::Tag::O_add);
-        } else if (accept('-')) {
-            if (accept('>')) return tok(Tok::Tag::P_arrow);
-            if (accept('-')) return tok(Tok::Tag::O_dec);
-            if (accept('=')) return tok(Tok::Tag::A_sub_assign);
-            return tok(Tok::Tag::O_sub);
-        } else if (accept('*')) {
-            if (accept('=')) return tok(Tok::Tag::A_mul_assign);
-            return tok(Tok::Tag::O_mul);
-        } else if (accept('/')) {
-            // Handle comments here
-            if (accept('*')) { eat_comments(); continue; }
-            if (accept('/')) {
-                while (!eof() && peek() != '\n') next();
-                continue;
-            }
-            if (accept('=')) return tok(Tok::Tag::A_div_assign);
-            return tok(Tok::Tag::O_div);
-        } else if (accept('%')) {
-            if (accept('=')) return tok(Tok::Tag::A_rem_assign);
-            return tok(Tok::Tag::O_rem);
-        } else if (accept('&')) {
-            if (accept('&')) return tok(Tok::Tag::O_and_and);
-            if (accept('=')) return tok(Tok::Tag::A_and_assign);
-            return tok(Tok::Tag::O_and);
-        } else if (accept('|')) {
-            if (accept('|')) return tok(Tok::Tag::O_or_or);
-            if (accept('=')) return tok(Tok::Tag::A_or_assign);
-            return tok(Tok::Tag::O_or);
-        } else if (accept('^')) {
-            if (accept('=')) return tok(Tok::Tag::A_xor_assign);
-            return tok(Tok::Tag::O_xor);
-        } else if (accept('!')) {
-            if (accept('=')) return tok(Tok::Tag::O_ne);
-            if (accept('[')) return tok(Tok::Tag::D_not_bracket_l);
-            return tok(Tok::Tag::O_not);
-        } else if (dec(peek()) || sgn(peek())) {
-            return parse_literal();
-        }
+        // literal
+        if (dec(peek())) return parse_literal();
 
         // identifier
-        if (accept_if(az_)) {
-            while (accept_if(az_) || accept_if(dec)) {}
-            auto sym = comp().sym(str_);
-            if (auto i = std::find_if(keys_.begin(), keys_.end(), [&](auto p) { return p.second == sym; }); i != keys_.end()) {
-                auto [tag, _] = *i;
-                return tok(tag);            // keyword
-            } else {
-                return tok(Tok::Tag::M_id); // identifier
-            }
+        if (az_(peek())) {
+            skip_to(scan::skip_id(ptr_, end_));
+            if (auto tag = classify(str()); tag != Tok::Tag::M_id)
+                return {span(), tag, comp().key(tag)};             // keyword
+            return {span(), Tok::Tag::M_id, comp().sym(str())};   // identifier
         }
 
-        comp().err(loc_, "invalid character '{}'", peek_bytes_);
+        err(span(peek_ptr_, ptr_), "invalid character '{}'", std::string(peek_str()));
         next();
     }
 }
 
+Toks Lexer::lex_all() {
+    Toks toks(comp());
+    while (true) {
+        auto tok = lex();
+        toks.push_back(tok);
+        if (tok.isa(Tok::Tag::M_eof)) return toks;
+    }
+}
+
 Tok Lexer::parse_literal() {
     int base = 10;
 
@@ -242,21 +337,17 @@ Tok Lexer::parse_literal() {
         switch (base) {
             case  2: while (accept_if(bin)) {} break;
             case  8: while (accept_if(oct)) {} break;
-            case 10: while (accept_if(dec)) {} break;
+            case 10: if (dec(peek())) skip_to(scan::skip_dec(ptr_, end_)); break;
             case 16: while (accept_if(hex)) {} break;
         }
     };
 
-    // sign
-    bool sign = false;
-    if (accept('+')) {}
-    else if (accept('-')) { sign = true; }
-
     // prefix starting with '0'
-    if (accept('0', false)) {
-        if      (accept('b', false)) base = 2;
-        else if (accept('x', false)) base = 16;
-        else if (accept('o', false)) base = 8;
+    auto digits = peek_ptr_;
+    if (accept('0')) {
+        if      (accept('b')) { base =  2; digits = peek_ptr_; }
+        else if (accept('x')) { base = 16; digits = peek_ptr_; }
+        else if (accept('o')) { base =  8; digits = peek_ptr_; }
     }
 
     parse_digits();
@@ -277,9 +368,212 @@ Tok Lexer::parse_literal() {
         }
     }
 
-    if (is_float) return {loc_, f64(strtod  (str().c_str(), nullptr      ))};
-    if (sign)     return {loc_, u64(strtoll (str().c_str(), nullptr, base))};
-    else          return {loc_, u64(strtoull(str().c_str(), nullptr, base))};
+    // parse directly from the source: no copy, no null terminator needed
+    if (is_float) {
+        f64 f = 0.0;
+        if (std::from_chars(digits, peek_ptr_, f).ec == std::errc::result_out_of_range) {
+            // from_chars does not tell an overflow from an underflow - which may still yield a subnormal number -
+            // but strtod does; it needs a copy, though
+            auto lit = std::string(str());
+            f = std::strtod(lit.c_str(), nullptr);
+            if (std::isinf(f)) err(span(), "floating-point literal '{}' is out of range", lit);
+        }
+        return {span(), f};
+    }
+
+    u64 u = 0;
+    auto ec = std::from_chars(digits, peek_ptr_, u, base).ec;
+    if (ec == std::errc::invalid_argument)
+        err(span(), "integer literal '{}' has no digits", std::string(str()));
+    else if (ec == std::errc::result_out_of_range)
+        err(span(), "integer literal '{}' does not fit into 64 bits", std::string(str()));
+    return {span(), u};
+}
+
+/*
+ * lex_parallel
+ */
+
+Toks lex_parallel(Comp& comp, Source&& src, size_t chunk_size) {
+    return lex_parallel(comp, comp.srcs().add(std::move(src)), chunk_size);
+}
+
+Toks lex_parallel(Comp& comp, const SourceManager::File& file, size_t chunk_size) {
+    auto text = file.src.text();
+    auto end = text.data() + text.size();
+
+    // chunks start at line begins: no token and no line comment spans two chunks - only multiline comments may
+    std::vector<size_t> bounds = {0};
+    while (text.size() - bounds.back() > chunk_size) {
+        auto nl = scan::find(text.data() + bounds.back() + chunk_size, end, '\n');
+        if (nl == end) break;
+        bounds.emplace_back(nl + 1 - text.data());
+    }
+    bounds.emplace_back(text.size());
+    auto n = bounds.size() - 1;
+
+    struct Chunk {
+        Toks toks;
+        Comp::Diags diags;
+        bool valid;
+        int num_errors;
+        bool ends_in_comment;
+        std::optional<u32> comment_begin;
+    };
+
+    auto lex = [&](size_t i, bool in_comment, int max_errors) {
+        Comp::Diags diags;
+        Comp::Capture capture(diags);
+        Lexer lexer(comp, file, bounds[i], bounds[i + 1], in_comment, max_errors);
+        auto toks = lexer.lex_all();
+        return Chunk{std::move(toks), std::move(diags), lexer.valid(), lexer.num_errors(), lexer.ends_in_comment(),
+                     lexer.comment_begin()};
+    };
+
+    std::vector<std::optional<Chunk>> chunks(n);
+    parallel_for(n, [&](size_t i) { chunks[i] = lex(i, false, comp.max_errors); });
+
+    // fix-up: re-lex each chunk that actually starts within a multiline comment,
+    // and the chunk in which the errors of all chunks so far reach Comp::max_errors with the errors left
+    Toks toks(comp);
+    std::optional<u32> open; // begin of the multiline comment still open at the end of the previous chunk
+    int num_errors = 0;
+    Tok eof;
+    for (size_t i = 0; i != n; ++i) {
+        if (open) chunks[i] = lex(i, true, comp.max_errors);
+        if (num_errors != 0 && num_errors + chunks[i]->num_errors >= comp.max_errors && comp.max_errors != 0)
+            chunks[i] = lex(i, bool(open), comp.max_errors - num_errors);
+        auto& chunk = *chunks[i];
+        num_errors += chunk.num_errors;
+        comp.flush(chunk.diags);
+        eof = chunk.toks[chunk.toks.size() - 1];
+        chunk.toks.pop_back();
+        toks.append(chunk.toks);
+
+        if (!chunk.ends_in_comment)
+            open.reset();
+        else if (chunk.comment_begin)
+            open = chunk.comment_begin;
+        if (!chunk.valid) break; // only the valid prefix is lexed
+    }
+
+    if (open) comp.err(Span(*open, eof.loc().begin), "non-terminated multiline comment");
+    toks.push_back(eof);
+    return toks;
+}
+
+/*
+ * LexerThread
+ */
+
+LexerThread::LexerThread(Comp& comp, Source&& src)
+    : comp_(comp)
+    , lexer_(comp, std::move(src))
+{
+    thread_ = std::thread([this] {
+        while (true) {
+            Slot slot;
+            {
+                Comp::Capture capture(slot.diags);
+                slot.tok = lexer_.lex();
+            }
+            bool eof = slot.tok.isa(Tok::Tag::M_eof);
+            if (!ring_.push(std::move(slot)) || eof) return;
+        }
+    });
+}
+
+LexerThread::~LexerThread() {
+    ring_.close(); // in case the consumer stops before M_eof
+    thread_.join();
+}
+
+Tok LexerThread::lex() {
+    if (done_) return eof_;
+    auto slot = ring_.pop();
+    comp_.flush(slot.diags);
+    if (slot.tok.isa(Tok::Tag::M_eof)) {
+        done_ = true;
+        eof_ = slot.tok;
+    }
+    return slot.tok;
+}
+
+/*
+ * Toks
+ */
+
+void Toks::push_back(const Tok& tok) {
+    u32 payload = 0;
+    switch (tok.tag()) {
+        case Tok::Tag::M_id: payload = tok.sym().id(); break;
+        case Tok::Tag::L_f:  payload = u32(lits_.size()); lits_.emplace_back(std::bit_cast<u64>(tok.f())); break;
+        case Tok::Tag::L_s:  payload = u32(lits_.size()); lits_.emplace_back(std::bit_cast<u64>(tok.s())); break;
+        case Tok::Tag::L_u:  payload = u32(lits_.size()); lits_.emplace_back(tok.u()); break;
+        default: break;
+    }
+
+    tags_.emplace_back(tok.tag());
+    offsets_.emplace_back(tok.loc().begin);
+    payloads_.emplace_back(payload);
+    finis_.emplace_back(tok.loc().finis);
+}
+
+void Toks::pop_back() {
+    if (tags_.back() == Tok::Tag::L_f || tags_.back() == Tok::Tag::L_s || tags_.back() == Tok::Tag::L_u)
+        lits_.pop_back();
+    tags_.pop_back();
+    offsets_.pop_back();
+    payloads_.pop_back();
+    finis_.pop_back();
+}
+
+void Toks::append(const Toks& other) {
+    auto n = size();
+    auto lits = u32(lits_.size());
+    tags_    .insert(tags_    .end(), other.tags_    .begin(), other.tags_    .end());
+    offsets_ .insert(offsets_ .end(), other.offsets_ .begin(), other.offsets_ .end());
+    payloads_.insert(payloads_.end(), other.payloads_.begin(), other.payloads_.end());
+    finis_   .insert(finis_   .end(), other.finis_   .begin(), other.finis_   .end());
+    lits_    .insert(lits_    .end(), other.lits_    .begin(), other.lits_    .end());
+
+    // rebase indices into lits_
+    for (auto i = n, e = size(); i != e; ++i) {
+        if (tags_[i] == Tok::Tag::L_f || tags_[i] == Tok::Tag::L_s || tags_[i] == Tok::Tag::L_u)
+            payloads_[i] += lits;
+    }
+}
+
+void Toks::append(const Toks& other, size_t begin, size_t end, u32 shift) {
+    auto n = size();
+    tags_    .insert(tags_    .end(), other.tags_    .begin() + begin, other.tags_    .begin() + end);
+    payloads_.insert(payloads_.end(), other.payloads_.begin() + begin, other.payloads_.begin() + end);
+    for (auto i = begin; i != end; ++i) {
+        offsets_.emplace_back(other.offsets_[i] + shift);
+        finis_  .emplace_back(other.finis_  [i] + shift);
+    }
+
+    // copy the literals and rebase indices into lits_
+    for (auto i = n, e = size(); i != e; ++i) {
+        if (tags_[i] == Tok::Tag::L_f || tags_[i] == Tok::Tag::L_s || tags_[i] == Tok::Tag::L_u) {
+            lits_.emplace_back(other.lits_[payloads_[i]]);
+            payloads_[i] = u32(lits_.size() - 1);
+        }
+    }
+}
+
+Tok Toks::operator[](size_t i) const {
+    auto tag = tags_[i];
+    auto loc = Span(offsets_[i], finis_[i]);
+    switch (tag) {
+        case Tok::Tag::M_id: return {loc, tag, comp_->syms().sym(payloads_[i])};
+        case Tok::Tag::L_f:  return {loc, std::bit_cast<f64>(lits_[payloads_[i]])};
+        case Tok::Tag::L_s:  return {loc, std::bit_cast<s64>(lits_[payloads_[i]])};
+        case Tok::Tag::L_u:  return {loc, lits_[payloads_[i]]};
+        default:
+            if (size_t(tag) < Num_Keys) return {loc, tag, comp_->key(tag)};
+            return {loc, tag};
+    }
 }
 
 }
@@ -1,6 +1,9 @@
 #include "dimpl/parser.h"
 
-#include <sstream>
+#include <algorithm>
+
+#include "dimpl/parallel.h"
+#include "dimpl/source.h"
 
 namespace dimpl {
 
@@ -23,6 +26,28 @@ namespace dimpl {
                     case Tok::Tag::K_struct:    \
                     case Tok::Tag::K_trait
 
+#define Tok__Tag__Delim_l Tok::Tag::D_angle_l:   \
+                     case Tok::Tag::D_brace_l:   \
+                     case Tok::Tag::D_bracket_l: \
+                     case Tok::Tag::D_not_bracket_l: \
+                     case Tok::Tag::D_paren_l:   \
+                     case Tok::Tag::D_quote_l
+
+#define Tok__Tag__Delim_r Tok::Tag::D_angle_r:   \
+                     case Tok::Tag::D_brace_r:   \
+                     case Tok::Tag::D_bracket_r: \
+                     case Tok::Tag::D_paren_r:   \
+                     case Tok::Tag::D_quote_r
+
+#define Tok__Tag__Prefix Tok::Tag::O_add:       \
+                    case Tok::Tag::O_and:       \
+                    case Tok::Tag::O_dec:       \
+                    case Tok::Tag::O_inc:       \
+                    case Tok::Tag::O_mul:       \
+                    case Tok::Tag::O_not:       \
+                    case Tok::Tag::O_sub:       \
+                    case Tok::Tag::O_tilde
+
 #define Tok__Tag__Expr   Tok::Tag::B_forall:    \
                     case Tok::Tag::B_lam:       \
                     case Tok::Tag::D_angle_l:   \
@@ -57,10 +82,68 @@ namespace dimpl {
                     case Tok::Tag::O_sub
 
 Parser::Parser(Comp& comp, std::istream& stream, const char* file)
-    : lexer_(comp, stream, file)
+    : comp_(comp)
+    , lexer_(std::in_place, comp, stream, file)
+    , own_toks_(comp)
+{
+    init();
+}
+
+Parser::Parser(Comp& comp, std::string_view text, const char* file)
+    : comp_(comp)
+    , lexer_(std::in_place, comp, text, file)
+    , own_toks_(comp)
+{
+    init();
+}
+
+Parser::Parser(Comp& comp, Source&& src)
+    : comp_(comp)
+    , lexer_(std::in_place, comp, std::move(src))
+    , own_toks_(comp)
+{
+    init();
+}
+
+Parser::Parser(Comp& comp, Toks&& toks)
+    : comp_(comp)
+    , own_toks_(std::move(toks))
+    , end_(own_toks_.size() - 1)
+{
+    assert(own_toks_.size() != 0 && own_toks_.tag(end_) == Tok::Tag::M_eof);
+    if (comp.lazy) {
+        toks_ = &comp.own(std::move(own_toks_));
+        lazy_ = true;
+    }
+    init();
+}
+
+Parser::Parser(Comp& comp, const Toks& toks, size_t begin, size_t end, bool lazy)
+    : comp_(comp)
+    , own_toks_(comp)
+    , toks_(&toks)
+    , cursor_(begin)
+    , end_(end)
+    , lazy_(lazy)
+{
+    assert(begin <= end && end < toks.size());
+    init();
+}
+
+Parser::Parser(Comp& comp, std::unique_ptr<LexerThread>&& lexer_thread)
+    : comp_(comp)
+    , lexer_thread_(std::move(lexer_thread))
+    , own_toks_(comp)
 {
-    for (int i = 0; i != max_ahead; ++i) lex();
-    prev_ = Loc(file, {1, 1}, {1, 1});
+    init();
+}
+
+void Parser::init() {
+    if (on_demand()) {
+        for (int i = 0; i != max_ahead; ++i) lex();
+    }
+    auto begin = ahead().loc().begin;
+    prev_ = {begin, begin};
 }
 
 /*
@@ -69,22 +152,75 @@ Parser::Parser(Comp& comp, std::istream& stream, const char* file)
 
 Tok Parser::lex() {
     auto result = ahead();
-    prev_ = ahead_[0].loc();
-    for (int i = 0; i < max_ahead - 1; ++i)
-        ahead_[i] = ahead_[i + 1];
-    ahead_[max_ahead - 1] = lexer_.lex();
+    prev_ = result.loc();
+    if (on_demand()) {
+        for (int i = 0; i < max_ahead - 1; ++i)
+            ahead_[i] = ahead_[i + 1];
+        if (!given_up_) ahead_[max_ahead - 1] = lexer_ ? lexer_->lex() : lexer_thread_->lex();
+    } else if (cursor_ < end_) {
+        ++cursor_; // stay on M_eof
+    }
     return result;
 }
 
+Ptr<ErrExpr> Parser::skip_nested() {
+    comp().err(ahead().loc(), "expression nested deeper than {} levels", comp().max_depth);
+    auto track = tracker();
+    for (int depth = 0; true; lex()) {
+        switch (ahead_tag()) {
+            case Tok__Tag__Delim_l: ++depth; continue;
+            case Tok__Tag__Delim_r: if (depth-- == 0) break; continue;
+            case Tok::Tag::M_eof:   break;
+            default:                continue;
+        }
+        // the enclosing Expr%s are most likely incomplete: do not report that again
+        err_begin_ = ahead().loc().begin;
+        return mk_ptr<ErrExpr>(track);
+    }
+}
+
+std::optional<LazyExpr> Parser::skip_block(bool operand) {
+    if (!lazy_ || ahead_tag() != Tok::Tag::D_brace_l) return {};
+
+    int depth = 0;
+    for (auto i = cursor_; i != end_; ++i) {
+        switch (toks_->tag(i)) {
+            case Tok::Tag::D_brace_l: ++depth; continue;
+            case Tok::Tag::D_brace_r: if (--depth == 0) break; continue;
+            default: continue;
+        }
+
+        // see parse_expr
+        if (operand && i + 1 != end_) {
+            switch (auto tag = toks_->tag(i + 1)) {
+                case Tok::Tag::P_dot:
+                case Tok::Tag::D_not_bracket_l:
+                case Tok::Tag::D_paren_l:
+                case Tok::Tag::D_bracket_l:
+                case Tok::Tag::O_inc:
+                case Tok::Tag::O_dec: return {};
+                default: if (Tok::tag2prec(tag) > Tok::Prec::Bottom) return {};
+            }
+        }
+
+        LazyExpr body(*toks_, cursor_, i + 1);
+        prev_ = {toks_->offset(i), toks_->finis(i)};
+        cursor_ = i + 1;
+        return body;
+    }
+
+    return {}; // unbalanced: report errors right away
+}
+
 bool Parser::accept(Tok::Tag tag) {
-    if (tag != ahead().tag())
+    if (tag != ahead_tag())
         return false;
     lex();
     return true;
 }
 
 bool Parser::expect(Tok::Tag tag, const char* ctxt) {
-    if (ahead().tag() == tag) {
+    if (ahead_tag() == tag) {
         lex();
         return true;
     }
@@ -94,7 +230,64 @@ bool Parser::expect(Tok::Tag tag, const char* ctxt) {
 
 void Parser::err(const std::string& what, const Tok& tok, const char* ctxt) {
     assert(ctxt);
+    // without any progress since the last error, this one is most likely a consequence of it
+    if (tok.loc().begin == err_begin_) return;
+    err_begin_ = tok.loc().begin;
     comp().err(tok.loc(), "expected {}, got '{}' while parsing {}", what, tok, ctxt);
+    if (++num_errors_ == comp().max_errors) give_up();
+}
+
+void Parser::recover() {
+    for (int depth = 0; true; lex()) {
+        switch (ahead_tag()) {
+            case Tok::Tag::M_eof: return;
+            case Tok::Tag::P_semicolon:
+                if (depth == 0) {
+                    lex();
+                    return;
+                }
+                continue;
+            case Tok__Tag__Nom:
+            case Tok::Tag::K_let:
+                if (depth == 0) return;
+                continue;
+            case Tok__Tag__Delim_l: ++depth; continue;
+            case Tok__Tag__Delim_r:
+                if (depth != 0)
+                    --depth;
+                else if (ahead_tag() == Tok::Tag::D_brace_r)
+                    return;
+                continue; // skip unmatched closers except for braces
+            default: continue;
+        }
+    }
+}
+
+void Parser::give_up() {
+    comp().note(ahead().loc(), "too many errors; giving up");
+    given_up_ = true;
+    if (on_demand())
+        ahead_.fill(Tok(ahead().loc(), Tok::Tag::M_eof));
+    else
+        end_ = cursor_;
+}
+
+void Parser::set_leaf_locs(const AST* parent, std::span<const AST* const> children) {
+    // the pending occurrences of parent's leaf children are on top of leaves_ in argument order;
+    // entries in between that do not match have been dropped during error recovery
+    std::array<Span, 8> locs;
+    size_t n = 0;
+    for (auto i = children.rbegin(), e = children.rend(); i != e; ++i) {
+        if (*i == nullptr) continue;
+        while (leaves_.back().first != *i) leaves_.pop_back();
+        locs[n++] = leaves_.back().second;
+        leaves_.pop_back();
+    }
+
+    if (n != 0) {
+        std::reverse(locs.begin(), locs.begin() + n);
+        comp().set_leaf_locs(parent, {locs.data(), n});
+    }
 }
 
 /*
@@ -103,25 +296,48 @@ void Parser::err(const std::string& what, const Tok& tok, const char* ctxt) {
 
 Ptr<Prg> Parser::parse_prg() {
     auto track = tracker();
-    Ptrs<Stmt> stmts;
-    while (!ahead().isa(Tok::Tag::M_eof)) {
-        switch (ahead().tag()) {
-            case Tok::Tag::P_semicolon: lex(); /* ignore semicolon */           continue;
-            case Tok__Tag__Nom:         stmts.emplace_back(parse_nom_stmt()); continue;
-            case Tok::Tag::K_let:       stmts.emplace_back(parse_let_stmt()); continue;
+    auto stmts = parse_stmts();
+    return mk_ptr<Prg>(track, stmts);
+}
+
+FlatAST Parser::parse_flat_prg() {
+    auto track = tracker();
+    Flattener flattener;
+    std::vector<FlatAST::Ref> stmts;
+    while (true) {
+        auto mark = comp().mark();
+        auto stmt = parse_stmt();
+        if (stmt == nullptr) break;
+        stmts.emplace_back(flattener.flatten(stmt));
+        comp().rewind(mark);
+    }
+    return flattener.finish(track, stmts);
+}
+
+Ptrs<Stmt> Parser::parse_stmts() {
+    PtrsBuilder<Stmt> stmts;
+    while (auto stmt = parse_stmt()) stmts.emplace_back(stmt);
+    return mk_ptrs(stmts);
+}
+
+Ptr<Stmt> Parser::parse_stmt() {
+    while (true) {
+        switch (ahead_tag()) {
+            case Tok::Tag::M_eof:       return nullptr;
+            case Tok::Tag::P_semicolon: lex(); /* ignore semicolon */ continue;
+            case Tok__Tag__Nom:         return parse_nom_stmt();
+            case Tok::Tag::K_let:       return parse_let_stmt();
             default:
                 err("nominal or let statement", "program");
-                lex();
+                do recover(); while (accept(Tok::Tag::D_brace_r)); // unmatched
         }
     }
-
-    return mk_ptr<Prg>(track, std::move(stmts));
 }
 
 Ptr<Id> Parser::parse_id(const char* ctxt) {
-    if (ctxt == nullptr || ahead().isa(Tok::Tag::M_id)) return mk_ptr<Id>(eat(Tok::Tag::M_id));
+    if (ctxt == nullptr || ahead_tag() == Tok::Tag::M_id) return mk_ptr<Id>(eat(Tok::Tag::M_id));
     err("identifier", ctxt);
-    return mk_ptr<Id>(tok_id(prev_, "<error>"));
+    return mk_ptr<Id>(tok_err(prev_));
 }
 
 Ptr<Expr> Parser::parse_type_ascr(const char* ascr_ctxt) {
@@ -138,7 +354,7 @@ Ptr<Expr> Parser::parse_type_ascr(const char* ascr_ctxt) {
  */
 
 Ptr<Nom> Parser::parse_nom() {
-    switch (ahead().tag()) {
+    switch (ahead_tag()) {
         case Tok::Tag::K_nom:    return parse_nom_nom();
         case Tok::Tag::B_lam:
         case Tok::Tag::K_cn:
@@ -155,6 +371,7 @@ Ptr<NomNom> Parser::parse_nom_nom() {
     auto id = parse_id("nominal");
     auto type = parse_type_ascr("type ascription of a nominal");
     expect(Tok::Tag::A_assign, "nominal");
+    if (auto body = skip_block(true)) return mk_ptr<NomNom>(track, std::move(id), std::move(type), *body);
     auto body = parse_expr("body of a nominal");
     return mk_ptr<NomNom>(track, std::move(id), std::move(type), std::move(body));
 }
@@ -162,15 +379,17 @@ Ptr<NomNom> Parser::parse_nom_nom() {
 Ptr<AbsNom> Parser::parse_abs_nom() {
     auto track = tracker();
     auto tag = lex().tag();
-    auto id = ahead().isa(Tok::Tag::M_id) ? parse_id() : mk_id("_");
+    auto id = ahead_tag() == Tok::Tag::M_id ? parse_id() : mk_anonymous_id();
 
-    Ptrs<Ptrn> doms;
-    while (ahead().tag() == Tok::Tag::D_paren_l)
+    PtrsBuilder<Ptrn> doms;
+    while (ahead_tag() == Tok::Tag::D_paren_l)
         doms.emplace_back(parse_tup_ptrn(Tok::Tag::D_paren_l, Tok::Tag::D_paren_r));
 
     auto codom = accept(Tok::Tag::P_arrow) ? parse_expr("codomain of an function") : mk_unk_expr();
+    if (auto body = skip_block(false))
+        return mk_ptr<AbsNom>(track, tag, std::move(id), mk_ptrs(doms), std::move(codom), *body);
     auto body = accept(Tok::Tag::A_assign) ? parse_expr("body of a function") : parse_block_expr("body of a function");
-    return mk_ptr<AbsNom>(track, tag, std::move(id), std::move(doms), std::move(codom), std::move(body));
+    return mk_ptr<AbsNom>(track, tag, std::move(id), mk_ptrs(doms), std::move(codom), std::move(body));
 }
 
 Ptr<SigNom> Parser::parse_sig_nom() {
@@ -187,7 +406,7 @@ Ptr<SigNom> Parser::parse_sig_nom() {
  */
 
 Ptr<Bndr> Parser::parse_bndr(const char* ctxt) {
-    switch (ahead().tag()) {
+    switch (ahead_tag()) {
         case Tok::Tag::M_id:        return parse_id_bndr();
         case Tok::Tag::D_bracket_l: return parse_sig_bndr();
         default:
@@ -200,12 +419,12 @@ Ptr<Bndr> Parser::parse_bndr(const char* ctxt) {
 Ptr<IdBndr> Parser::parse_id_bndr() {
     auto track = tracker();
 
-    Ptr<Id> id;
-    if (ahead(0).isa(Tok::Tag::M_id) && ahead(1).isa(Tok::Tag::P_colon)) {
+    Ptr<Id> id = nullptr;
+    if (ahead_tag() == Tok::Tag::M_id && ahead_tag(1) == Tok::Tag::P_colon) {
         id = parse_id();
         eat(Tok::Tag::P_colon);
     } else {
-        id = mk_id("_");
+        id = mk_anonymous_id();
     }
 
     auto type = parse_expr("type of an identifier binder");
@@ -225,7 +444,7 @@ Ptr<SigBndr> Parser::parse_sig_bndr() {
  */
 
 Ptr<Ptrn> Parser::parse_ptrn(const char* ctxt) {
-    switch (ahead().tag()) {
+    switch (ahead_tag()) {
         case Tok::Tag::K_mut:
         case Tok::Tag::M_id:      return parse_id_ptrn();
         case Tok::Tag::D_paren_l: return parse_tup_ptrn(Tok::Tag::D_paren_l, Tok::Tag::D_paren_r);
@@ -247,9 +466,9 @@ Ptr<IdPtrn> Parser::parse_id_ptrn() {
 }
 
 Ptr<TupPtrn> Parser::parse_tup_ptrn(Tok::Tag delim_l, Tok::Tag delim_r, const char* ctxt) {
-    if (ctxt && !ahead().isa(delim_l)) {
+    if (ctxt && ahead_tag() != delim_l) {
         err("tuple pattern", ctxt);
-        return mk_ptr<TupPtrn>(prev_, mk_ptrs<Ptrn>(), delim_l == Tok::Tag::D_paren_l);
+        return mk_ptr<TupPtrn>(prev_, Ptrs<Ptrn>(), delim_l == Tok::Tag::D_paren_l);
     }
 
     auto track = tracker();
@@ -263,27 +482,122 @@ Ptr<TupPtrn> Parser::parse_tup_ptrn(Tok::Tag delim_l, Tok::Tag delim_r, const ch
  */
 
 Ptr<Expr> Parser::parse_expr(const char* ctxt, Tok::Prec p) {
-    auto track = tracker();
-    auto lhs = parse_primary_expr(ctxt);
+    // precedence climbing; operators waiting for their right operand and tuples waiting for their next element are kept
+    // in ops_ instead of on the native stack
+    auto base = ops_.size();
+    auto begin = tracker().begin();
+    Ptr<Expr> lhs = nullptr;
 
     while (true) {
-        switch (ahead().tag()) {
-            case Tok::Tag::P_dot:       lhs = parse_field_expr  (track, std::move(lhs)); continue;
-            case Tok::Tag::D_not_bracket_l:
-            case Tok::Tag::D_paren_l:
-            case Tok::Tag::D_bracket_l: lhs = parse_app_expr    (track, std::move(lhs)); continue;
-            case Tok::Tag::O_inc:
-            case Tok::Tag::O_dec:       lhs = parse_postfix_expr(track, std::move(lhs)); continue;
-            default: break;
+        while (lhs == nullptr) {
+            switch (ahead_tag()) {
+                case Tok__Tag__Prefix:
+                    ops_.emplace_back(begin, p, nullptr, lex().tag());
+                    begin = tracker().begin();
+                    p = Tok::Prec::Unary;
+                    ctxt = "right-hand side of a unary expression";
+                    continue;
+                case Tok::Tag::D_paren_l:
+                    lhs = open_tup(nullptr, begin, p, ctxt);
+                    continue;
+                default:
+                    lhs = parse_primary_expr(ctxt);
+            }
         }
 
-        if (auto q = Tok::tag2prec(ahead().tag()); p < q)
-            lhs = parse_infix_expr(track, std::move(lhs));
-        else
-            break;
+        while (true) {
+            auto track = tracker(begin);
+            switch (ahead_tag()) {
+                case Tok::Tag::P_dot:       lhs = parse_field_expr  (track, std::move(lhs)); continue;
+                case Tok::Tag::D_not_bracket_l:
+                case Tok::Tag::D_paren_l:
+                case Tok::Tag::D_bracket_l: lhs = open_tup(std::move(lhs), begin, p, ctxt);
+                                            if (lhs == nullptr) break; // parse first argument
+                                            continue;
+                case Tok::Tag::O_inc:
+                case Tok::Tag::O_dec:       lhs = parse_postfix_expr(track, std::move(lhs)); continue;
+                default: break;
+            }
+            if (lhs == nullptr) break;
+
+            if (auto q = Tok::tag2prec(ahead_tag()); p < q) {
+                ops_.emplace_back(begin, p, lhs, lex().tag());
+                begin = tracker().begin();
+                p = q;
+                ctxt = "right-hand side of a binary expression";
+                lhs = nullptr;
+                break; // parse right operand
+            }
+
+            // lhs is complete: hand it to the innermost pending operator or tuple
+            if (ops_.size() == base) return lhs;
+            auto op = ops_.back();
+            if (is_tup(op)) {
+                lhs = next_tup_elem(std::move(lhs), begin, p, ctxt);
+                if (lhs == nullptr) break; // parse next element
+                continue;
+            }
+
+            ops_.pop_back();
+            if (op.lhs)
+                lhs = mk_ptr<InfixExpr>(tracker(op.begin), std::move(op.lhs), op.tag, std::move(lhs));
+            else
+                lhs = mk_ptr<PrefixExpr>(tracker(op.begin), op.tag, std::move(lhs));
+            begin = op.begin;
+            p = op.prec;
+        }
     }
+}
+
+Ptr<Expr> Parser::open_tup(Ptr<Expr>&& callee, u32& begin, Tok::Prec& p, const char*& ctxt) {
+    auto delim_l = ahead_tag();
+    tups_.emplace_back(tracker().begin(), u32(-1), tup_elems_.size(), nullptr);
+    ops_.emplace_back(begin, p, std::move(callee), delim_l);
+    lex();
+    if (ahead_tag() == tup_delim_r(delim_l)) return close_tup(begin, p);
+    start_tup_elem(begin, p, ctxt);
+    return nullptr;
+}
 
-    return lhs;
+void Parser::start_tup_elem(u32& begin, Tok::Prec& p, const char*& ctxt) {
+    auto& tup = tups_.back();
+    tup.elem = tracker().begin();
+    if (ahead_tag() == Tok::Tag::M_id && ahead_tag(1) == Tok::Tag::A_assign) {
+        tup.id = parse_id();
+        eat(Tok::Tag::A_assign);
+    } else {
+        tup.id = mk_anonymous_id();
+    }
+    begin = tracker().begin();
+    p = Tok::Prec::Bottom;
+    ctxt = "tuple element";
+}
+
+Ptr<Expr> Parser::next_tup_elem(Ptr<Expr>&& elem, u32& begin, Tok::Prec& p, const char*& ctxt) {
+    auto& tup = tups_.back();
+    tup_elems_.emplace_back(mk_ptr<TupElem>(tracker(tup.elem), std::move(tup.id), std::move(elem)));
+    if (accept(Tok::Tag::P_comma) && ahead_tag() != tup_delim_r(ops_.back().tag)) {
+        start_tup_elem(begin, p, ctxt);
+        return nullptr;
+    }
+    return close_tup(begin, p);
+}
+
+Ptr<Expr> Parser::close_tup(u32& begin, Tok::Prec& p) {
+    auto op  = ops_.back();
+    auto tup = tups_.back();
+    ops_.pop_back();
+    tups_.pop_back();
+    expect(tup_delim_r(op.tag), "tuple");
+
+    auto elems = comp().mk_ptrs(std::span<const Ptr<TupElem>>(tup_elems_.begin() + tup.elems, tup_elems_.end()));
+    tup_elems_.resize(tup.elems);
+    auto type = parse_type_ascr();
+    auto tup_expr = mk_ptr<TupExpr>(tracker(tup.begin), std::move(elems), std::move(type));
+    begin = op.begin;
+    p = op.prec;
+    if (op.lhs) return mk_ptr<AppExpr>(tracker(op.begin), op.tag, std::move(op.lhs), std::move(tup_expr));
+    return tup_expr;
 }
 
 Ptr<Expr> Parser::parse_prefix_expr() {
@@ -293,22 +607,11 @@ Ptr<Expr> Parser::parse_prefix_expr() {
     return mk_ptr<PrefixExpr>(track, tag, std::move(rhs));
 }
 
-Ptr<Expr> Parser::parse_infix_expr(Tracker track, Ptr<Expr>&& lhs) {
-    auto tag = lex().tag();
-    auto rhs = parse_expr("right-hand side of a binary expression", Tok::tag2prec(tag));
-    return mk_ptr<InfixExpr>(track, std::move(lhs), tag, std::move(rhs));
-}
-
 Ptr<Expr> Parser::parse_postfix_expr(Tracker track, Ptr<Expr>&& lhs) {
     auto tag = lex().tag();
     return mk_ptr<PostfixExpr>(track, std::move(lhs), tag);
 }
 
-Ptr<AppExpr> Parser::parse_app_expr(Tracker track, Ptr<Expr>&& callee) {
-    auto delim_l = ahead().tag();
-    return mk_ptr<AppExpr>(track, delim_l, std::move(callee), parse_tup_expr(delim_l));
-}
-
 Ptr<FieldExpr> Parser::parse_field_expr(Tracker track, Ptr<Expr>&& lhs) {
     eat(Tok::Tag::P_dot);
     auto id = parse_id("field expression");
@@ -320,20 +623,20 @@ Ptr<FieldExpr> Parser::parse_field_expr(Tracker track, Ptr<Expr>&& lhs) {
  */
 
 Ptr<Expr> Parser::parse_primary_expr(const char* ctxt) {
-    switch (ahead().tag()) {
+    if (depth_ == comp().max_depth && depth_ != 0) return skip_nested();
+    struct Nest {
+        Nest(int& depth) : depth(++depth) {}
+        ~Nest() { --depth; }
+        int& depth;
+    } nest(depth_);
+
+    switch (ahead_tag()) {
         case Tok::Tag::K_Kind:
         case Tok::Tag::K_Nat:
         case Tok::Tag::K_Type:
         case Tok::Tag::K_false:
-        case Tok::Tag::K_true:      return mk_ptr<KeyExpr>(lex());
-        case Tok::Tag::O_add:
-        case Tok::Tag::O_and:
-        case Tok::Tag::O_dec:
-        case Tok::Tag::O_inc:
-        case Tok::Tag::O_mul:
-        case Tok::Tag::O_not:
-        case Tok::Tag::O_sub:
-        case Tok::Tag::O_tilde:     return parse_prefix_expr();
+        case Tok::Tag::K_true:      { auto tok = lex(); return mk_leaf(comp().key_expr(tok.tag()), tok.loc()); }
+        case Tok__Tag__Prefix:      return parse_prefix_expr();
         case Tok::Tag::B_forall:
         case Tok::Tag::K_Cn:
         case Tok::Tag::K_Fn:        return parse_pi_expr();
@@ -346,7 +649,6 @@ Ptr<Expr> Parser::parse_primary_expr(const char* ctxt) {
         case Tok::Tag::K_ar:        return parse_ar_expr();
         case Tok::Tag::D_brace_l:   return parse_block_expr();
         case Tok::Tag::D_bracket_l: return parse_sig_expr();
-        case Tok::Tag::D_paren_l:   return parse_tup_expr();
         case Tok::Tag::K_for:       return parse_for_expr();
         case Tok::Tag::K_if:        return parse_if_expr();
         case Tok::Tag::K_match:     return parse_match_expr();
@@ -366,57 +668,62 @@ Ptr<Expr> Parser::parse_primary_expr(const char* ctxt) {
 Ptr<AbsExpr> Parser::parse_abs_expr() {
     auto track = tracker();
     auto tag = lex().tag();
-    auto id = mk_id("_");
-    auto is_delim_r = [&]() { return ahead().isa(Tok::Tag::A_assign) || ahead().isa(Tok::Tag::D_brace_l); };
+    auto id = mk_anonymous_id();
+    auto is_delim_r = [&]() { return ahead_tag() == Tok::Tag::A_assign || ahead_tag() == Tok::Tag::D_brace_l; };
 
     auto p_track = tracker();
-    Ptrs<Ptrn> elems;
+    PtrsBuilder<Ptrn> elems;
     if (!is_delim_r()) {
         do {
             elems.emplace_back(parse_ptrn("domain of a function"));
         } while (accept(Tok::Tag::P_comma) && !is_delim_r());
     }
 
-    Ptrs<Ptrn> doms;
-    doms.emplace_back(mk_ptr<TupPtrn>(p_track, std::move(elems), false));
+    PtrsBuilder<Ptrn> doms;
+    doms.emplace_back(mk_ptr<TupPtrn>(p_track, mk_ptrs(elems), false));
 
     auto codom = accept(Tok::Tag::P_arrow) ? parse_expr("codomain of an function") : mk_unk_expr();
-    auto body = accept(Tok::Tag::A_assign) ? parse_expr("body of a function") : parse_block_expr("body of a function");
-    auto abs_nom = mk_ptr<AbsNom>(track, tag, std::move(id), std::move(doms), std::move(codom), std::move(body));
+    Ptr<AbsNom> abs_nom = nullptr;
+    if (auto lazy = skip_block(false)) {
+        abs_nom = mk_ptr<AbsNom>(track, tag, std::move(id), mk_ptrs(doms), std::move(codom), *lazy);
+    } else {
+        auto body = accept(Tok::Tag::A_assign) ? parse_expr("body of a function")
+                                               : parse_block_expr("body of a function");
+        abs_nom = mk_ptr<AbsNom>(track, tag, std::move(id), mk_ptrs(doms), std::move(codom), std::move(body));
+    }
     return mk_ptr<AbsExpr>(track, std::move(abs_nom));
 }
 
 Ptr<BlockExpr> Parser::parse_block_expr(const char* ctxt) {
-    if (ctxt && !ahead().isa(Tok::Tag::D_brace_l)) {
+    if (ctxt && ahead_tag() != Tok::Tag::D_brace_l) {
         err("block expression", ctxt);
         return mk_block_expr();
     }
 
     auto track = tracker();
     eat(Tok::Tag::D_brace_l);
-    Ptrs<Stmt> stmts;
-    Ptr<Expr> final_expr;
+    PtrsBuilder<Stmt> stmts;
+    Ptr<Expr> final_expr = nullptr;
 
     while (true) {
-        switch (ahead().tag()) {
+        switch (ahead_tag()) {
             case Tok::Tag::P_semicolon: lex(); /* ignore semicolon */         continue;
             case Tok::Tag::K_nom:
             case Tok::Tag::K_struct:
             case Tok::Tag::K_trait:     stmts.emplace_back(parse_nom_stmt()); continue;
             case Tok::Tag::K_let:       stmts.emplace_back(parse_let_stmt()); continue;
             case Tok::Tag::D_brace_r:   {
-                final_expr = mk_unit_tup();
                 eat(Tok::Tag::D_brace_r);
-                return mk_ptr<BlockExpr>(track, std::move(stmts), mk_unit_tup());
+                return mk_ptr<BlockExpr>(track, mk_ptrs(stmts), mk_unit_tup());
             }
             case Tok__Tag__Expr: {
                 auto expr_track = tracker();
-                Ptr<Expr> expr;
-                switch (ahead().tag()) {
+                Ptr<Expr> expr = nullptr;
+                switch (ahead_tag()) {
                     case Tok::Tag::K_cn:
                     case Tok::Tag::K_fn:
                     case Tok::Tag::B_lam:
-                        if (ahead(1).tag() == Tok::Tag::M_id) {
+                        if (ahead_tag(1) == Tok::Tag::M_id) {
                             stmts.emplace_back(parse_nom_stmt());
                             continue;
                         }
@@ -425,7 +732,7 @@ Ptr<BlockExpr> Parser::parse_block_expr(const char* ctxt) {
                         expr = parse_expr();
                 }
 
-                switch (ahead().tag()) {
+                switch (ahead_tag()) {
                     case Tok__Tag__Assign: {
                         auto tag = lex().tag();
                         auto rhs = parse_expr("right-hand side of an assignment statement");
@@ -437,19 +744,27 @@ Ptr<BlockExpr> Parser::parse_block_expr(const char* ctxt) {
                         stmts.emplace_back(mk_ptr<ExprStmt>(expr_track, std::move(expr)));
                         continue;
                     default:
-                        if (expr->is_stmt_like() && !ahead().isa(Tok::Tag::D_brace_r)) {
+                        if (expr->is_stmt_like() && ahead_tag() != Tok::Tag::D_brace_r) {
                             stmts.emplace_back(mk_ptr<ExprStmt>(expr_track, std::move(expr)));
                             continue;
                         }
                 }
 
-                swap(final_expr, expr);
+                final_expr = expr;
                 [[fallthrough]];
             }
             default:
+                if (ahead_tag() != Tok::Tag::D_brace_r && ahead_tag() != Tok::Tag::M_eof) {
+                    err("'}'", "block expression");
+                    recover();
+                    if (ahead_tag() != Tok::Tag::D_brace_r && ahead_tag() != Tok::Tag::M_eof) {
+                        final_expr = nullptr; // resume with the next Stmt
+                        continue;
+                    }
+                }
                 expect(Tok::Tag::D_brace_r, "block expression");
                 if (final_expr == nullptr) final_expr = mk_unit_tup();
-                return mk_ptr<BlockExpr>(track, std::move(stmts), std::move(final_expr));
+                return mk_ptr<BlockExpr>(track, mk_ptrs(stmts), std::move(final_expr));
         }
     }
 }
@@ -459,15 +774,38 @@ Ptr<IdExpr> Parser::parse_id_expr() {
 }
 
 Ptr<IfExpr> Parser::parse_if_expr() {
-    auto track = tracker();
-    eat(Tok::Tag::K_if);
-    auto cond = parse_expr("condition of an if-expression");
-    auto then_expr = parse_block_expr("consequence of an if-expression");
-    auto else_expr = accept(Tok::Tag::K_else)
-        ? ahead().isa(Tok::Tag::K_if) ? (Ptr<Expr>)parse_if_expr() : (Ptr<Expr>)parse_block_expr("alternative of an if-expression")
-        : mk_block_expr();
+    // collect an else-if chain first and build it from its end
+    struct Link {
+        u32 begin;
+        Ptr<Expr> cond;
+        Ptr<Expr> then_expr;
+    };
+    std::vector<Link> chain;
+    Ptr<Expr> else_expr = nullptr;
 
-    return mk_ptr<IfExpr>(track, std::move(cond), std::move(then_expr), std::move(else_expr));
+    while (true) {
+        auto begin = tracker().begin();
+        eat(Tok::Tag::K_if);
+        auto cond = parse_expr("condition of an if-expression");
+        auto then_expr = parse_block_expr("consequence of an if-expression");
+        chain.emplace_back(begin, cond, then_expr);
+
+        if (!accept(Tok::Tag::K_else)) {
+            else_expr = mk_block_expr();
+            break;
+        }
+        if (ahead_tag() != Tok::Tag::K_if) {
+            else_expr = parse_block_expr("alternative of an if-expression");
+            break;
+        }
+    }
+
+    Ptr<IfExpr> if_expr = nullptr;
+    for (auto i = chain.rbegin(), e = chain.rend(); i != e; ++i) {
+        if_expr = mk_ptr<IfExpr>(tracker(i->begin), std::move(i->cond), std::move(i->then_expr), std::move(else_expr));
+        else_expr = if_expr;
+    }
+    return if_expr;
 }
 
 Ptr<ForExpr> Parser::parse_for_expr() {
@@ -479,7 +817,8 @@ Ptr<ForExpr> Parser::parse_for_expr() {
 }
 
 Ptr<LitExpr> Parser::parse_lit_expr() {
-    return mk_ptr<LitExpr>(lex());
+    auto tok = lex();
+    return mk_leaf(comp().lit_expr(tok), tok.loc());
 }
 
 Ptr<MatchExpr> Parser::parse_match_expr() {
@@ -506,17 +845,17 @@ Ptr<PiExpr> Parser::parse_pi_expr() {
     auto track = tracker();
     auto tag = lex().tag();
 
-    Ptrs<Bndr> doms;
-    while (ahead().tag() == Tok::Tag::D_bracket_l)
+    PtrsBuilder<Bndr> doms;
+    while (ahead_tag() == Tok::Tag::D_bracket_l)
         doms.emplace_back(parse_sig_bndr());
 
-    Ptr<Expr> codom;
+    Ptr<Expr> codom = nullptr;
     if (tag != Tok::Tag::K_Cn) {
         expect(Tok::Tag::P_arrow, Tok::tag2str(tag));
         codom = parse_expr("codomain");
     }
 
-    return mk_ptr<PiExpr>(track, tag, std::move(doms), std::move(codom));
+    return mk_ptr<PiExpr>(track, tag, mk_ptrs(doms), std::move(codom));
 }
 
 Ptr<SigExpr> Parser::parse_sig_expr() {
@@ -526,26 +865,6 @@ Ptr<SigExpr> Parser::parse_sig_expr() {
     return mk_ptr<SigExpr>(track, std::move(elems));
 }
 
-Ptr<TupExpr> Parser::parse_tup_expr(Tok::Tag delim_l) {
-    auto track = tracker();
-    auto delim_r = delim_l == Tok::Tag::D_bracket_l ? Tok::Tag::D_bracket_r : Tok::Tag::D_paren_r;
-    auto elems = parse_list("tuple", delim_l, delim_r, [&]{
-        auto track = tracker();
-        Ptr<Id> id;
-        if (ahead(0).isa(Tok::Tag::M_id) && ahead(1).isa(Tok::Tag::A_assign)) {
-            id = parse_id();
-            eat(Tok::Tag::A_assign);
-        } else {
-            id = mk_id("_");
-        }
-        auto expr = parse_expr("tuple element");
-        return mk_ptr<TupElem>(track, std::move(id), std::move(expr));
-    });
-
-    auto type = parse_type_ascr();
-    return mk_ptr<TupExpr>(track, std::move(elems), std::move(type));
-}
-
 Ptr<ArExpr> Parser::parse_ar_expr() {
     auto track = tracker();
     bool quote = accept(Tok::Tag::D_quote_l);
@@ -584,7 +903,7 @@ Ptr<LetStmt> Parser::parse_let_stmt() {
     auto track = tracker();
     eat(Tok::Tag::K_let);
     auto ptrn = parse_ptrn("let statement");
-    Ptr<Expr> init;
+    Ptr<Expr> init = nullptr;
     if (accept(Tok::Tag::A_assign))
         init = parse_expr("initialization expression of a let statement");
     expect(Tok::Tag::P_semicolon, "the end of a let statement");
@@ -598,14 +917,28 @@ Ptr<NomStmt> Parser::parse_nom_stmt() {
 
 //------------------------------------------------------------------------------
 
+/*
+ * LazyExpr
+ */
+
+Ptr<Expr> LazyExpr::get(Comp& comp) const {
+    if (!parsed()) expr_ = Parser(comp, *toks_, begin_, end_, true).parse_block_expr("body of a nominal");
+    return expr_;
+}
+
 Ptr<Expr> parse_expr(Comp& comp, std::istream& is, const char* file) {
     Parser parser(comp, is, file);
     return parser.parse_expr("global expression");
 }
 
-Ptr<Expr> parse_expr(Comp& comp, const char* str) {
-    std::istringstream in(str);
-    return parse_expr(comp, in, "<inline>");
+Ptr<Expr> parse_expr(Comp& comp, std::string_view text, const char* file) {
+    Parser parser(comp, text, file);
+    return parser.parse_expr("global expression");
+}
+
+Ptr<Expr> parse_expr(Comp& comp, Source&& src) {
+    Parser parser(comp, std::move(src));
+    return parser.parse_expr("global expression");
 }
 
 Ptr<Prg> parse(Comp& comp, std::istream& is, const char* file) {
@@ -613,9 +946,85 @@ Ptr<Prg> parse(Comp& comp, std::istream& is, const char* file) {
     return parser.parse_prg();
 }
 
-Ptr<Prg> parse(Comp& comp, const char* str) {
-    std::istringstream in(str);
-    return parse(comp, in, "<inline>");
+Ptr<Prg> parse(Comp& comp, std::string_view text, const char* file) {
+    Parser parser(comp, text, file);
+    return parser.parse_prg();
+}
+
+Ptr<Prg> parse(Comp& comp, Source&& src) {
+    Parser parser(comp, std::move(src));
+    return parser.parse_prg();
+}
+
+Ptr<Prg> parse_parallel(Comp& comp, Toks&& toks, size_t chunk_size, size_t* num_chunks) {
+    // pre-pass: find the chunk boundaries
+    auto eof = toks.size() - 1;
+    std::vector<size_t> bounds = {0};
+    int depth = 0;
+    for (size_t i = 0; i != eof; ++i) {
+        switch (toks.tag(i)) {
+            case Tok__Tag__Delim_l: ++depth; continue;
+            case Tok__Tag__Delim_r: --depth; break;
+            case Tok::Tag::P_semicolon:      break;
+            default:                         continue;
+        }
+
+        if (depth != 0 || i + 1 - bounds.back() < chunk_size) continue;
+        if (toks.tag(i) != Tok::Tag::P_semicolon && toks.tag(i) != Tok::Tag::D_brace_r) continue;
+        switch (toks.tag(i + 1)) {
+            case Tok__Tag__Nom:
+            case Tok::Tag::K_let: bounds.emplace_back(i + 1); break;
+            default:              break;
+        }
+    }
+    bounds.emplace_back(eof);
+
+    auto n = bounds.size() - 1;
+    const auto& all = comp.lazy ? comp.own(std::move(toks)) : toks;
+    if (num_chunks) *num_chunks = n;
+    if (n == 1) return Parser(comp, all, 0, eof, comp.lazy).parse_prg();
+
+    struct Chunk {
+        Ptrs<Stmt> stmts;
+        Comp::Diags diags;
+    };
+    std::vector<Chunk> chunks(n);
+    parallel_for(n, [&](size_t i) {
+        Comp::Capture capture(chunks[i].diags);
+        Comp::LocalArena arena(comp);
+        chunks[i].stmts = Parser(comp, all, bounds[i], bounds[i + 1], comp.lazy).parse_stmts();
+    });
+
+    // a chunk may also have been cut at the wrong place in erroneous input
+    if (std::ranges::any_of(chunks, [](const Chunk& chunk) { return !chunk.diags.text.empty(); })) {
+        if (num_chunks) *num_chunks = 1;
+        return Parser(comp, all, 0, eof, comp.lazy).parse_prg();
+    }
+
+    PtrsBuilder<Stmt> stmts;
+    for (const auto& chunk : chunks) {
+        for (auto stmt : chunk.stmts) stmts.emplace_back(stmt);
+    }
+
+    return comp.mk<Prg>(Span(all.offset(0), all.finis(eof - 1)), comp.mk_ptrs(stmts));
+}
+
+Ptr<Prg> parse_file(Comp& comp, const char* file) {
+    if (comp.pipeline) {
+        Parser parser(comp, std::make_unique<LexerThread>(comp, Source(file)));
+        return parser.parse_prg();
+    }
+
+    return parse_parallel(comp, lex_parallel(comp, Source(file)));
+}
+
+FlatAST parse_flat_file(Comp& comp, const char* file) {
+    if (comp.pipeline) {
+        Parser parser(comp, std::make_unique<LexerThread>(comp, Source(file)));
+        return parser.parse_flat_prg();
+    }
+
+    return Parser(comp, lex_parallel(comp, Source(file))).parse_flat_prg();
 }
 
 }
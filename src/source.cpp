@@ -0,0 +1,166 @@
+#include "dimpl/source.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dimpl/scan.h"
+
+namespace dimpl {
+
+Source::Source(const char* filename)
+    : filename_(filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) throw std::runtime_error(std::string("cannot open file '") + filename + "'");
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error(std::string("cannot stat file '") + filename + "'");
+    }
+
+    if (st.st_size != 0) {
+        map_size_ = size_t(st.st_size);
+        map_ = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map_ == MAP_FAILED) {
+            map_ = nullptr;
+            close(fd);
+            throw std::runtime_error(std::string("cannot map file '") + filename + "'");
+        }
+        madvise(map_, map_size_, MADV_SEQUENTIAL);
+        text_ = {static_cast<const char*>(map_), map_size_};
+    }
+
+    close(fd);
+}
+
+Source::Source(Source&& other)
+    : filename_(other.filename_)
+{
+    *this = std::move(other);
+}
+
+Source& Source::operator=(Source&& other) {
+    if (this != &other) {
+        unmap();
+        bool owned = other.text_.data() == other.owned_.data();
+        filename_ = other.filename_;
+        owned_    = std::move(other.owned_);
+        text_     = owned ? std::string_view(owned_) : other.text_;
+        map_      = other.map_;
+        map_size_ = other.map_size_;
+        other.text_ = {};
+        other.map_ = nullptr;
+        other.map_size_ = 0;
+    }
+    return *this;
+}
+
+Source::~Source() { unmap(); }
+
+void Source::unmap() {
+    if (map_) munmap(map_, map_size_);
+    map_ = nullptr;
+}
+
+/*
+ * SourceManager
+ */
+
+const SourceManager::File& SourceManager::add(Source&& src) {
+    // leave room for one offset past the end so each File has its own position for <eof>
+    if (src.text().size() >= std::numeric_limits<uint32_t>::max() - end_)
+        throw std::runtime_error(std::string("sources exceed 4 GiB with '") + src.filename() + "'");
+
+    auto base = end_;
+    end_ += uint32_t(src.text().size()) + 1;
+    return files_.emplace_back(File{std::move(src), base});
+}
+
+const SourceManager::File& SourceManager::edit(const File& prev, Source&& src, uint32_t offset, uint32_t removed,
+                                                uint32_t inserted) {
+    assert(offset + removed <= prev.src.text().size() && prev.edit.next == nullptr);
+    assert(prev.src.text().size() - removed + inserted == src.text().size());
+    auto& next = add(std::move(src));
+    auto& old = *(std::upper_bound(files_.begin(), files_.end(), prev.base,
+                                   [](uint32_t o, const File& f) { return o < f.base; }) - 1);
+    old.edit = {&next, offset, removed, inserted};
+    old.src = Source::borrow({}, old.src.filename());
+    old.lines.clear();
+    return next;
+}
+
+const SourceManager::File& SourceManager::rebase(const File& first, Source&& src) {
+    size_t n = 0;
+    for (auto f = &first; f; f = f->edit.next) ++n;
+
+    // the versions of first are the last n Files iff first is the n-th last one
+    if (n <= files_.size() && &files_[files_.size() - n] == &first) {
+        end_ = first.base;
+        files_.erase(files_.end() - n, files_.end());
+    }
+    return add(std::move(src));
+}
+
+const SourceManager::File& SourceManager::file(uint32_t offset) const {
+    assert(!files_.empty() && offset < end_);
+    auto i = std::upper_bound(files_.begin(), files_.end(), offset, [](uint32_t o, const File& f) { return o < f.base; });
+    return *(i - 1);
+}
+
+thorin::Pos SourceManager::pos(const File& file, uint32_t offset) const {
+    auto text = file.src.text();
+    {
+        std::lock_guard<std::mutex> guard(lines_mutex_);
+        if (file.lines.empty()) {
+            file.lines.emplace_back(0);
+            auto b = text.data(), e = b + text.size();
+            for (auto p = scan::find(b, e, '\n'); p != e; p = scan::find(p + 1, e, '\n'))
+                file.lines.emplace_back(uint32_t(p + 1 - b));
+        }
+    }
+
+    offset -= file.base;
+    auto line = std::upper_bound(file.lines.begin(), file.lines.end(), offset) - 1;
+    auto lead = [](char c) { return (c & 0b11000000) != 0b10000000; };
+    auto col  = std::count_if(text.data() + *line, text.data() + offset, lead);
+    return {uint32_t(line - file.lines.begin()) + 1, uint32_t(col) + 1};
+}
+
+thorin::Loc SourceManager::loc(Span span) const {
+    auto f = &file(span.begin);
+
+    // move span through all later versions; a bound within removed bytes sticks to the inserted ones
+    for (; f->edit.next; f = f->edit.next) {
+        auto& e = f->edit;
+        auto move = [&](uint32_t o, uint32_t removed_to) {
+            o -= f->base;
+            if (o < e.offset) return e.next->base + o;
+            if (o < e.offset + e.removed) return e.next->base + e.offset + removed_to;
+            return e.next->base + o - e.removed + e.inserted;
+        };
+        span = {move(span.begin, 0), move(span.finis, e.inserted)};
+    }
+
+    return loc(*f, span);
+}
+
+thorin::Loc SourceManager::loc(const File& f, Span span) const {
+    auto begin = pos(f, span.begin);
+    if (span.finis <= span.begin) return {f.src.filename(), begin, begin};
+
+    // finis is inclusive in Loc: it is the position of the last code point in span
+    auto text = f.src.text();
+    auto last = span.finis - 1;
+    while (last != span.begin && (text[last - f.base] & 0b11000000) == 0b10000000) --last;
+    return {f.src.filename(), begin, pos(f, last)};
+}
+
+}
@@ -4,131 +4,263 @@
 #include "thorin/util/stream.h"
 
 #include "dimpl/ast.h"
+#include "dimpl/walk.h"
 
 namespace dimpl {
 
-/*
- * misc
- */
+namespace {
+
+/// Prints the AST in one walk; see Walker.
+class Printer : public Walker<Printer> {
+public:
+    Printer(Stream& s)
+        : s(s)
+    {}
+
+    using Walker::enter;
+    using Walker::child;
+    using Walker::exit;
+
+    /// The @p i-th of @p ptrs preceded by @p sep unless it is the first one.
+    template<class T>
+    const AST* list(const Ptrs<T>& ptrs, size_t i, const char* sep) {
+        if (i != 0 && i < ptrs.size()) s.fmt(sep);
+        return i < ptrs.size() ? ptrs[i] : nullptr;
+    }
+    /// <tt>dims; body</tt> of a PkExpr or ArExpr.
+    template<class T>
+    const AST* dims(const T* ast, size_t i) {
+        if (i < ast->dims.size()) return list(ast->dims, i, ", ");
+        if (i == ast->dims.size()) return s.fmt("; "), ast->body;
+        return nullptr;
+    }
+
+    /*
+     * misc
+     */
+
+    bool enter(const Id* id) { return s.fmt("{}", id->sym), true; }
+    const AST* child(const Prg* prg, size_t i) { return list(prg->stmts, i, "\n"); }
+
+    /*
+     * Nom
+     */
+
+    bool enter(const NomNom* nom) { return s.fmt("nom {}: ", nom->id->sym), true; }
+    bool enter(const AbsNom*);
+    const AST* child(const NomNom*, size_t);
+    const AST* child(const AbsNom*, size_t);
+
+    /*
+     * Bndr
+     */
+
+    bool enter(const ErrBndr*) { return s.fmt("<error binder>"), true; }
+    bool enter(const SigBndr*) { return s.fmt("["), true; }
+    bool enter(const IdBndr*);
+    const AST* child(const SigBndr* bndr, size_t i) { return list(bndr->elems, i, ", "); }
+    void exit(const SigBndr*) { s.fmt("]"); }
 
-Stream& Prg::stream(Stream& s) const { return s.fmt("{\n}", stmts); }
-Stream& Id ::stream(Stream& s) const { return s.fmt("{}", sym); }
+    /*
+     * Ptrn
+     */
+
+    bool enter(const ErrPtrn*) { return s.fmt("<error pattern>"), true; }
+    bool enter(const IdPtrn* ptrn) { return s.fmt("{}{}: ", ptrn->mut ? "mut " : "", ptrn->id->sym), true; }
+    bool enter(const TupPtrn* ptrn) { return s.fmt(ptrn->delims ? "(" : ""), true; }
+    const AST* child(const TupPtrn* ptrn, size_t i) { return list(ptrn->elems, i, ", "); }
+    void exit(const TupPtrn* ptrn) { s.fmt(ptrn->delims ? ")" : ""); }
+
+    /*
+     * Expr
+     */
+
+    bool enter(const ArExpr*     ) { return s.fmt("«"),                    true; }
+    bool enter(const BottomExpr* ) { return s.fmt("⊥"),                    true; }
+    bool enter(const ErrExpr*    ) { return s.fmt("<error expression>"),   true; }
+    bool enter(const ForExpr*    ) { return s.fmt("for "),                 true; }
+    bool enter(const IdExpr*    e) { return s.fmt("{}", e->id->sym),       true; }
+    bool enter(const IfExpr*     ) { return s.fmt("if "),                  true; }
+    bool enter(const InfixExpr*  ) { return s.fmt("("),                    true; }
+    bool enter(const KeyExpr*   e) { return s.fmt("{}", Tok::tag2str(e->tag)), true; }
+    bool enter(const PkExpr*     ) { return s.fmt("‹"),                    true; }
+    bool enter(const PostfixExpr*) { return s.fmt("("),                    true; }
+    bool enter(const PrefixExpr*e) { return s.fmt("({}", e->tag),          true; }
+    bool enter(const SigExpr*    ) { return s.fmt("["),                    true; }
+    bool enter(const TupExpr*    ) { return s.fmt("("),                    true; }
+    bool enter(const UnkExpr*    ) { return s.fmt("<?>"),                  true; }
+    bool enter(const VarExpr*   e) { return s.fmt("var {}", e->id->sym),   true; }
+    bool enter(const WhileExpr*  ) { return s.fmt("while "),               true; }
+    bool enter(const BlockExpr*  ) { return s.fmt("{{\t\n"),               true; }
+    bool enter(const LitExpr*);
+    bool enter(const PiExpr*);
+
+    const AST* child(const ArExpr*    e, size_t i) { return dims(e, i); }
+    const AST* child(const PkExpr*    e, size_t i) { return dims(e, i); }
+    const AST* child(const SigExpr*   e, size_t i) { return list(e->elems, i, ", "); }
+    const AST* child(const TupExpr*   e, size_t i) { return list(e->elems, i, ", "); }
+    const AST* child(const AppExpr*,    size_t);
+    const AST* child(const BlockExpr*,  size_t);
+    const AST* child(const ForExpr*,    size_t);
+    const AST* child(const IfExpr*,     size_t);
+    const AST* child(const InfixExpr*,  size_t);
+    const AST* child(const PiExpr*,     size_t);
+    const AST* child(const WhileExpr*,  size_t);
+
+    void exit(const ArExpr*      ) { s.fmt("»"); }
+    void exit(const FieldExpr*  e) { s.fmt(".{}", e->id->sym); }
+    void exit(const InfixExpr*   ) { s.fmt(")"); }
+    void exit(const PkExpr*      ) { s.fmt("›"); }
+    void exit(const PostfixExpr*e) { s.fmt("{})", e->tag); }
+    void exit(const PrefixExpr*  ) { s.fmt(")"); }
+    void exit(const SigExpr*     ) { s.fmt("]"); }
+    void exit(const TupExpr*     ) { s.fmt(")"); }
+    void exit(const BlockExpr*   ) { s.fmt("\b\n}}"); }
+    void exit(const AppExpr*);
+
+    /*
+     * Stmt
+     */
+
+    bool enter(const LetStmt*) { return s.fmt("let "), true; }
+    const AST* child(const AssignStmt*, size_t);
+    const AST* child(const LetStmt*, size_t);
+    void exit(const ExprStmt*  ) { s.fmt(";"); }
+    void exit(const AssignStmt*) { s.fmt(";"); }
+    void exit(const LetStmt*   ) { s.fmt(";"); }
+    void exit(const NomStmt*);
+
+private:
+    Stream& s;
+};
 
 /*
- * nom
+ * Nom
  */
 
-Stream& NomNom::stream(Stream& s) const {
-    return s.fmt("nom {}: {} = {}", id, type, body);
+const AST* Printer::child(const NomNom* nom, size_t i) {
+    if (i == 1) s.fmt(" = ");
+    return dimpl::child(nom, i);
+}
+
+bool Printer::enter(const AbsNom* abs) {
+    s.fmt("{} ", abs->tag);
+    if (!abs->id->is_anonymous()) s.fmt("{}", abs->id->sym);
+    return true;
 }
 
-Stream& AbsNom::stream(Stream& s) const {
-    s.fmt("{} ", tag);
-    if (!id->is_anonymous()) id->stream(s);
-    s.fmt("{}", doms);
-    if (!comp.fancy || !isa<UnkExpr>(codom)) s.fmt(" → {} ", codom);
-    auto is_block = isa<BlockExpr>(body);
-    return s.fmt("{}{}", is_block ? "" : "= ", body);
+const AST* Printer::child(const AbsNom* abs, size_t i) {
+    auto n = abs->doms.size();
+    if (i < n) return abs->doms[i];
+
+    bool codom = !abs->comp.fancy || !isa<UnkExpr>(abs->codom);
+    if (codom && i == n) return s.fmt(" → "), abs->codom;
+    if (i == n + codom) {
+        s.fmt(codom ? " " : "");
+        s.fmt(isa<BlockExpr>(abs->body()) ? "" : "= ");
+        return abs->body();
+    }
+    return nullptr;
 }
 
 /*
  * Bndr
  */
 
-Stream& ErrBndr::stream(Stream& s) const { return s.fmt("<error binder>"); }
-Stream& SigBndr::stream(Stream& s) const { return s.fmt("[{, }]", elems); }
-
-Stream& IdBndr::stream(Stream& s) const {
-    if (comp.fancy && id->is_anonymous()) return s.fmt("{}", type);
-    return s.fmt("{}: {}", id, type);
+bool Printer::enter(const IdBndr* bndr) {
+    if (!bndr->comp.fancy || !bndr->id->is_anonymous()) s.fmt("{}: ", bndr->id->sym);
+    return true;
 }
 
 /*
- * Ptrn
+ * Expr
  */
 
-Stream& IdPtrn ::stream(Stream& s) const { return s.fmt("{}{}: {}", mut ? "mut " : "", id, type); }
-Stream& ErrPtrn::stream(Stream& s) const { return s.fmt("<error pattern>"); }
+bool Printer::enter(const LitExpr* e) {
+    switch (e->tag) {
+        case Tok::Tag::L_f: s.fmt("{}", e->f()); break;
+        case Tok::Tag::L_s: s.fmt("{}", e->s()); break;
+        case Tok::Tag::L_u: s.fmt("{}", e->u()); break;
+        default: THORIN_UNREACHABLE;
+    }
+    return true;
+}
 
-Stream& TupPtrn::stream(Stream& s) const {
-    if (delims) return s.fmt("({, })", elems);
-    return s.fmt("{, }", elems);
+bool Printer::enter(const PiExpr* e) {
+    if (e->tag == Tok::Tag::K_Cn)
+        s.fmt("Cn ");
+    else
+        s.fmt("{} ", e->tag);
+    return true;
 }
 
-/*
- * Expr
- */
+const AST* Printer::child(const PiExpr* e, size_t i) {
+    if (e->tag == Tok::Tag::K_Cn) return list(e->doms, i, "");
+    if (i == e->doms.size()) s.fmt(" → ");
+    return dimpl::child(e, i);
+}
 
-Stream& AbsExpr    ::stream(Stream& s) const { return s.fmt("{}", abs); }
-Stream& ArExpr     ::stream(Stream& s) const { return s.fmt("«{, }; {}»", dims, body); }
-Stream& BottomExpr ::stream(Stream& s) const { return s.fmt("⊥"); }
-Stream& ErrExpr    ::stream(Stream& s) const { return s.fmt("<error expression>"); }
-Stream& FieldExpr  ::stream(Stream& s) const { return s.fmt("{}.{}", lhs, id); }
-Stream& ForExpr    ::stream(Stream& s) const { return s.fmt("for {} in {} {}", ptrn, expr, body); }
-Stream& IdExpr     ::stream(Stream& s) const { return s.fmt("{}", id); }
-Stream& IfExpr     ::stream(Stream& s) const { return s.fmt("if {} {} else {}", cond, then_expr, else_expr); }
-Stream& InfixExpr  ::stream(Stream& s) const { return s.fmt("({} {} {})", lhs, tag, rhs); }
-Stream& KeyExpr    ::stream(Stream& s) const { return s.fmt("{}", Tok::tag2str(tag)); }
-Stream& PkExpr     ::stream(Stream& s) const { return s.fmt("‹{, }; {}›", dims, body); }
-Stream& PostfixExpr::stream(Stream& s) const { return s.fmt("({}{})", lhs, tag); }
-Stream& PrefixExpr ::stream(Stream& s) const { return s.fmt("({}{})", tag, rhs); }
-Stream& SigExpr    ::stream(Stream& s) const { return s.fmt("[{, }]", elems); }
-Stream& TupElem    ::stream(Stream& s) const { return s.fmt("{}", expr); }
-Stream& TupExpr    ::stream(Stream& s) const { return s.fmt("({, })", elems); }
-Stream& UnkExpr    ::stream(Stream& s) const { return s.fmt("<?>"); }
-Stream& VarExpr    ::stream(Stream& s) const { return s.fmt("var {}", id); }
-Stream& WhileExpr  ::stream(Stream& s) const { return s.fmt("while {} {}", cond, body); }
-
-Stream& AppExpr::stream(Stream& s) const {
-    auto [delim_l, delim_r] = tag == Tok::Tag::D_bracket_l ? std::pair( "[", "]") :
-                              tag == Tok::Tag::D_paren_l   ? std::pair( "(", ")") :
-                                                             std::pair("!(", ")");
-    return s.fmt("{}{}{}{}", callee, delim_l, arg, delim_r);
-}
-
-Stream& BlockExpr::stream(Stream& s) const {
-    s.fmt("{{\t\n");
-    s.fmt("{\n}", stmts);
-    if (!stmts.empty()) s.endl();
-    s.fmt("{}\b\n", expr);
-    s.fmt("}}");
-    return s;
+const AST* Printer::child(const AppExpr* e, size_t i) {
+    if (i == 1) s.fmt(e->tag == Tok::Tag::D_bracket_l ? "[" : e->tag == Tok::Tag::D_paren_l ? "(" : "!(");
+    return dimpl::child(e, i);
 }
 
-Stream& LitExpr::stream(Stream& stream) const {
-    switch (tag) {
-        case Tok::Tag::L_f: return stream.fmt("{}", f());
-        case Tok::Tag::L_s: return stream.fmt("{}", s());
-        case Tok::Tag::L_u: return stream.fmt("{}", u());
-        default: THORIN_UNREACHABLE;
-    }
+void Printer::exit(const AppExpr* e) { s.fmt(e->tag == Tok::Tag::D_bracket_l ? "]" : ")"); }
+
+const AST* Printer::child(const BlockExpr* e, size_t i) {
+    if (i < e->stmts.size()) return list(e->stmts, i, "\n");
+    if (i == e->stmts.size() && !e->stmts.empty()) s.endl();
+    return dimpl::child(e, i);
 }
 
-Stream& PiExpr::stream(Stream& s) const {
-    if (tag == Tok::Tag::K_Cn) return s.fmt("Cn {}", doms);
-    return s.fmt("{} {} → {}", tag, doms, codom);
+const AST* Printer::child(const ForExpr* e, size_t i) {
+    if (i == 1) s.fmt(" in ");
+    if (i == 2) s.fmt(" ");
+    return dimpl::child(e, i);
+}
+
+const AST* Printer::child(const IfExpr* e, size_t i) {
+    if (i == 1) s.fmt(" ");
+    if (i == 2) s.fmt(" else ");
+    return dimpl::child(e, i);
+}
+
+const AST* Printer::child(const InfixExpr* e, size_t i) {
+    if (i == 1) s.fmt(" {} ", e->tag);
+    return dimpl::child(e, i);
+}
+
+const AST* Printer::child(const WhileExpr* e, size_t i) {
+    if (i == 1) s.fmt(" ");
+    return dimpl::child(e, i);
 }
 
 /*
  * Stmt
  */
 
-Stream& ExprStmt  ::stream(Stream& s) const { return s.fmt("{};", expr); }
-Stream& AssignStmt::stream(Stream& s) const { return s.fmt("{} {} {};", lhs, tag, rhs); }
+const AST* Printer::child(const AssignStmt* stmt, size_t i) {
+    if (i == 1) s.fmt(" {} ", stmt->tag);
+    return dimpl::child(stmt, i);
+}
 
-Stream& LetStmt::stream(Stream& s) const {
-    if (init)
-        return s.fmt("let {} = {};", ptrn, init);
-    else
-        return s.fmt("let {};", ptrn);
+const AST* Printer::child(const LetStmt* stmt, size_t i) {
+    if (i == 1 && stmt->init) s.fmt(" = ");
+    return dimpl::child(stmt, i);
 }
 
-Stream& NomStmt::stream(Stream& s) const {
-    s.fmt("{}", nom);
-    if (auto abs_nom = isa<AbsNom>(nom); abs_nom && !isa<BlockExpr>(abs_nom->body))
-        return s.fmt(";");
+void Printer::exit(const NomStmt* stmt) {
+    if (auto abs_nom = isa<AbsNom>(stmt->nom); abs_nom && !isa<BlockExpr>(abs_nom->body()))
+        s.fmt(";");
     else
-        return s.fmt("\n");
+        s.fmt("\n");
+}
+
+}
+
+Stream& AST::stream(Stream& s) const {
+    Printer(s).walk(this);
+    return s;
 }
 
 }
@@ -0,0 +1,48 @@
+#include "dimpl/streaming.h"
+
+#include "dimpl/parser.h"
+
+namespace dimpl {
+
+size_t for_each_item(Parser& parser, Scopes& scopes, const std::function<void(const Ptrs<Stmt>&)>& f) {
+    auto& comp = parser.comp();
+    size_t num = 0;
+
+    scopes.push();
+    for (bool eof = false; !eof;) {
+        auto mark = comp.mark();
+        PtrsBuilder<Stmt> stmts;
+        while (true) {
+            auto stmt = parser.parse_stmt();
+            if (stmt == nullptr) {
+                eof = true;
+                break;
+            }
+            stmts.emplace_back(stmt);
+            if (!isa<NomStmt>(stmt)) break;
+        }
+        if (stmts.empty()) break;
+
+        auto item = comp.mk_ptrs(stmts);
+        scopes.bind_stmts(item);
+        f(item);
+        scopes.stub_decls();
+        comp.rewind(mark);
+        ++num;
+    }
+    scopes.pop();
+
+    return num;
+}
+
+size_t for_each_item(Comp& comp, const char* file, Scopes& scopes, const std::function<void(const Ptrs<Stmt>&)>& f) {
+    if (comp.pipeline) {
+        Parser parser(comp, std::make_unique<LexerThread>(comp, Source(file)));
+        return for_each_item(parser, scopes, f);
+    }
+
+    Parser parser(comp, Source(file));
+    return for_each_item(parser, scopes, f);
+}
+
+}
@@ -0,0 +1,61 @@
+#include "dimpl/sym.h"
+
+#include <cstring>
+
+namespace dimpl {
+
+// FNV-1a
+static u32 hash(std::string_view s) {
+    u32 h = 2166136261_u32;
+    for (auto c : s) {
+        h ^= u32(u8(c));
+        h *= 16777619_u32;
+    }
+    return h;
+}
+
+SymTable::Shard::Shard()
+    : table(64, nullptr)
+{}
+
+Sym SymTable::sym(std::string_view s) {
+    auto h = hash(s);
+    auto n = h >> (32_u32 - Shard_Bits); // the table index below uses the low bits
+    auto& shard = shards_[n];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    auto mask = shard.table.size() - 1;
+    for (auto i = h & mask; true; i = (i + 1) & mask) {
+        auto entry = shard.table[i];
+        if (entry == nullptr) {
+            auto mem = static_cast<Sym::Entry*>(shard.arena.alloc(sizeof(Sym::Entry) + s.size(), alignof(Sym::Entry)));
+            *mem = {u32(shard.syms.size()) << Shard_Bits | n, u32(s.size()), h};
+            std::memcpy(mem + 1, s.data(), s.size());
+            shard.table[i] = mem;
+            shard.syms.emplace_back(mem);
+            if (2 * shard.syms.size() > shard.table.size()) shard.rehash();
+            return Sym(mem);
+        }
+
+        if (entry->hash == h && Sym(entry).str() == s) return Sym(entry);
+    }
+}
+
+size_t SymTable::size() const {
+    size_t result = 0;
+    for (auto&& shard : shards_) result += shard.syms.size();
+    return result;
+}
+
+void SymTable::Shard::rehash() {
+    std::vector<const Sym::Entry*> new_table(2 * table.size(), nullptr);
+    auto mask = new_table.size() - 1;
+    for (auto entry : syms) {
+        auto i = entry->hash & mask;
+        while (new_table[i]) i = (i + 1) & mask;
+        new_table[i] = entry;
+    }
+    swap(new_table, table);
+}
+
+}